@@ -0,0 +1,35 @@
+//
+// Created by season on 2021/7/16.
+//
+
+#pragma once
+#include "Writer.h"
+
+// Extracts an entry into a buffer the caller owns, without allocating.
+// Entries larger than the buffer fail.
+class BufferWriter : public Writer {
+public:
+    BufferWriter(uint8_t *buffer, size_t size, size_t declared_length)
+            : buffer_(buffer), size_(size), declared_length_(declared_length),
+              total_bytes_written_(0) {}
+
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
+        if (total_bytes_written_ + buf_size > declared_length_ ||
+            total_bytes_written_ + buf_size > size_) {
+            return false;
+        }
+        memcpy(buffer_ + total_bytes_written_, buf, buf_size);
+        total_bytes_written_ += buf_size;
+        return true;
+    }
+
+    virtual uint8_t *GetDirectBuffer() override {
+        return declared_length_ <= size_ ? buffer_ : nullptr;
+    }
+
+private:
+    uint8_t *const buffer_;
+    const size_t size_;
+    const size_t declared_length_;
+    size_t total_bytes_written_;
+};
@@ -0,0 +1,33 @@
+//
+// Created by season on 2021/7/16.
+//
+
+#pragma once
+#include <functional>
+#include "Writer.h"
+
+// Hands each piece of an entry to a callback as it is produced, for
+// consumers such as hashes or parsers that need the data but not a copy of
+// it. Pieces are only valid during the call. A callback returning "false"
+// fails the extraction.
+class CallbackWriter : public Writer {
+public:
+    typedef std::function<bool(const uint8_t *data, size_t size)> Callback;
+
+    CallbackWriter(const Callback &callback, size_t declared_length)
+            : callback_(callback), declared_length_(declared_length),
+              total_bytes_written_(0) {}
+
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
+        if (total_bytes_written_ + buf_size > declared_length_) {
+            return false;
+        }
+        total_bytes_written_ += buf_size;
+        return callback_(buf, buf_size);
+    }
+
+private:
+    const Callback callback_;
+    const size_t declared_length_;
+    size_t total_bytes_written_;
+};
@@ -0,0 +1,65 @@
+//
+// Created by season on 2021/7/13.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "IoUring.h"
+#include "MappedZipFile.h"
+#include "Macros.h"
+
+namespace hms {
+    /*
+     * Reads a range of the archive in consecutive chunks of up to
+     * IoUring::kBufferSize bytes. Given a ring, and an archive read with
+     * pread, the read of the next chunk is in flight while the caller works
+     * on the current one; otherwise each chunk is read when it is asked for.
+     */
+    class ChunkReader {
+    public:
+        // |buffer| holds IoUring::kBufferSize bytes. |ring| may be |nullptr|.
+        ChunkReader(const MappedZipFile *zip, IoUring *ring, uint8_t *buffer,
+                    off64_t offset, uint64_t length);
+
+        // Waits for a read still in flight, whose buffer is about to be reused.
+        ~ChunkReader();
+
+        /*
+         * Point |data| at the next chunk and set |size| to its length. The
+         * chunk stays valid until the next call.
+         *
+         * Returns "false" on a read error.
+         */
+        bool Next(const uint8_t **data, size_t *size);
+
+        // Bytes of the range not handed out by Next yet.
+        uint64_t GetRemaining() const { return remaining_; }
+
+    private:
+        bool StartRead(uint8_t *buffer);
+
+        bool FinishRead(uint8_t **buffer, size_t *size);
+
+        const MappedZipFile *const zip_;
+        IoUring *const ring_;
+        uint8_t *buffers_[2];
+
+        // Next offset to request, bytes not requested yet, and bytes not
+        // handed out yet.
+        off64_t next_offset_;
+        uint64_t unrequested_;
+        uint64_t remaining_;
+
+        // The read in flight, if |token_| is not 0.
+        uint64_t token_;
+        uint8_t *pending_buffer_;
+        size_t pending_size_;
+        off64_t pending_offset_;
+
+        DISALLOW_COPY_AND_ASSIGN(ChunkReader);
+    };
+}
@@ -0,0 +1,26 @@
+//
+// Created by season on 2021/7/11.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hms {
+    /*
+     * CRC-32 as used by Zip (and zlib's crc32()), computed with the carry-less
+     * multiply instructions on x86 (PCLMULQDQ) or the CRC32 instructions on
+     * ARMv8 when the CPU has them, and with zlib otherwise. The choice is
+     * made once, at the first call.
+     */
+    class Crc32 {
+    public:
+        // Extend |crc|, the CRC of the data so far (0 initially), with the
+        // |length| bytes at |data|.
+        static uint32_t Update(uint32_t crc, const uint8_t *data, size_t length);
+
+        // Name of the implementation in use, for logs.
+        static const char *GetImplementationName();
+    };
+}
@@ -0,0 +1,91 @@
+//
+// Created by season on 2021/7/12.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "InflateContext.h"
+#include "Macros.h"
+
+namespace hms {
+    // Engine used to inflate deflated entries.
+    enum DecompressorType {
+        // Per call: the archive's OpenOptions::decompressor. Per archive: zlib.
+        kDecompressorDefault = 0,
+
+        // zlib's inflate(). Entries that do not fit an InflateContext buffer
+        // are streamed through it, so memory use stays bounded.
+        kDecompressorZlib,
+
+        // The in-tree whole-buffer decoder (DeflateDecoder), usually well
+        // ahead of zlib. Every entry is decoded in one go, so entries that
+        // are not in a mapped archive, or whose writer has no direct buffer,
+        // are staged in heap buffers of their full size; entries that would
+        // need more than 32 MB of them are streamed through zlib instead.
+        kDecompressorDeflate,
+    };
+
+    /*
+     * Decodes a whole raw DEFLATE stream into a buffer of the exact
+     * uncompressed size. Implementations are stateless and shared by all
+     * threads.
+     */
+    class Decompressor {
+    public:
+        enum Result {
+            kSuccess = 0,
+            // The stream is malformed or truncated.
+            kCorrupt,
+            // The stream does not decode to exactly |output_length| bytes.
+            kSizeMismatch,
+        };
+
+        // The implementation for |type|; kDecompressorDefault means zlib.
+        static Decompressor *Get(DecompressorType type);
+
+        virtual ~Decompressor() {}
+
+        // Name of the implementation, for logs and benchmarks.
+        virtual const char *GetName() const = 0;
+
+        /*
+         * Decode |input| into the |output_length| bytes at |output|. |context|
+         * is a pooled context of the calling thread the implementation may
+         * use as scratch.
+         */
+        virtual Result Decompress(InflateContext *context,
+                                  const uint8_t *input, size_t input_length,
+                                  uint8_t *output, size_t output_length) = 0;
+    };
+
+    class ZlibDecompressor : public Decompressor {
+    public:
+        ZlibDecompressor() {}
+
+        virtual const char *GetName() const override { return "zlib"; }
+
+        virtual Result Decompress(InflateContext *context,
+                                  const uint8_t *input, size_t input_length,
+                                  uint8_t *output, size_t output_length) override;
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(ZlibDecompressor);
+    };
+
+    class DeflateDecompressor : public Decompressor {
+    public:
+        DeflateDecompressor() {}
+
+        virtual const char *GetName() const override { return "deflate"; }
+
+        virtual Result Decompress(InflateContext *context,
+                                  const uint8_t *input, size_t input_length,
+                                  uint8_t *output, size_t output_length) override;
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(DeflateDecompressor);
+    };
+}
@@ -0,0 +1,39 @@
+//
+// Created by season on 2021/7/12.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hms {
+    /*
+     * Whole-buffer decoder for raw DEFLATE streams (RFC 1951).
+     *
+     * Unlike zlib's inflate() it never has to stop for lack of input or
+     * output space: the whole stream and a destination of the exact decoded
+     * size are given up front. That removes the window copy and the
+     * resumable state machine, and lets the hot loop decode a literal/length
+     * and distance pair after a single refill of a 64-bit bit buffer, using
+     * two-level lookup tables and word-sized match copies.
+     */
+    class DeflateDecoder {
+    public:
+        enum Result {
+            kSuccess = 0,
+            // The stream is malformed, or ends before its final block.
+            kCorrupt,
+            // The stream decodes to more or fewer bytes than |output_length|.
+            kSizeMismatch,
+        };
+
+        /*
+         * Decode the raw DEFLATE stream at |input| into |output|, which must
+         * be exactly |output_length| bytes long. Bytes after the end of the
+         * final block are ignored. Safe to call from any number of threads.
+         */
+        static Result Decode(const uint8_t *input, size_t input_length,
+                             uint8_t *output, size_t output_length);
+    };
+}
@@ -0,0 +1,136 @@
+//
+// Created by season on 2021/7/16.
+//
+
+#pragma once
+#include <fcntl.h>
+#include "FileWriter.h"
+
+class DirectFileWriter : public Writer {
+public:
+    // O_DIRECT transfers must be aligned in memory, offset and length.
+    static const size_t kAlignment = 4096;
+    static const size_t kBufferSize = 1024 * 1024;
+
+    // Creates a writer for |fd|, opened with O_DIRECT, sized for |entry|
+    // like a FileWriter. Appended data is gathered in an aligned buffer and
+    // written in aligned blocks, bypassing the page cache; the last block is
+    // padded, and the file truncated back to the entry's end. If the file
+    // system turns O_DIRECT writes down, the writer clears O_DIRECT and
+    // carries on with ordinary writes.
+    //
+    // Returns |nullptr| whenever a FileWriter should be used instead.
+    static std::unique_ptr<DirectFileWriter> Create(int fd, const ZipEntry *entry) {
+        const int flags = fcntl(fd, F_GETFL);
+        if (flags == -1 || (flags & O_DIRECT) == 0) {
+            return std::unique_ptr<DirectFileWriter>(nullptr);
+        }
+
+        off64_t current_offset;
+        bool reserved;
+        if (!FileWriter::Prepare(fd, entry, &current_offset, &reserved) ||
+            current_offset % kAlignment != 0) {
+            return std::unique_ptr<DirectFileWriter>(nullptr);
+        }
+
+        void *buffer = nullptr;
+        if (posix_memalign(&buffer, kAlignment, kBufferSize) != 0) {
+            return std::unique_ptr<DirectFileWriter>(nullptr);
+        }
+        return std::unique_ptr<DirectFileWriter>(new DirectFileWriter(
+                fd, static_cast<uint8_t *>(buffer), current_offset, entry->uncompressed_length));
+    }
+
+    virtual ~DirectFileWriter() {
+        free(buffer_);
+    }
+
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
+        if (total_bytes_written_ + buf_size > declared_length_) {
+            HLOGW("Zip: Unexpected size "
+            ZD
+            " (declared) vs "
+            ZD
+            " (actual)", declared_length_,
+                    total_bytes_written_ + buf_size);
+            return false;
+        }
+
+        total_bytes_written_ += buf_size;
+        while (buf_size > 0) {
+            const size_t n = std::min(buf_size, kBufferSize - buffered_);
+            memcpy(buffer_ + buffered_, buf, n);
+            buffered_ += n;
+            buf += n;
+            buf_size -= n;
+            if (buffered_ == kBufferSize && !WriteBuffer(kBufferSize)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual bool Flush() override {
+        if (buffered_ == 0) {
+            return true;
+        }
+        // Pad the tail to a whole block, then cut the file back.
+        const size_t padded = (buffered_ + kAlignment - 1) / kAlignment * kAlignment;
+        memset(buffer_ + buffered_, 0, padded - buffered_);
+        if (!WriteBuffer(padded)) {
+            return false;
+        }
+        if (TEMP_FAILURE_RETRY(ftruncate64(fd_, start_offset_ + declared_length_)) == -1) {
+            HLOGW("Zip: unable to truncate file to %" PRId64 ": %s",
+                  static_cast<int64_t>(start_offset_ + declared_length_), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+private:
+    DirectFileWriter(int fd, uint8_t *buffer, off64_t start_offset, size_t declared_length)
+            : Writer(), fd_(fd), buffer_(buffer), start_offset_(start_offset),
+              declared_length_(declared_length), total_bytes_written_(0), buffered_(0),
+              write_offset_(start_offset) {}
+
+    // Write the first |size| bytes of the buffer, a multiple of kAlignment.
+    bool WriteBuffer(size_t size) {
+        const uint8_t *data = buffer_;
+        while (size > 0) {
+            const ssize_t n = TEMP_FAILURE_RETRY(pwrite64(fd_, data, size, write_offset_));
+            if (n == -1 && errno == EINVAL && ClearDirect()) {
+                continue;
+            }
+            if (n <= 0) {
+                HLOGW("Zip: unable to write " ZD " bytes to file; %s", size, strerror(errno));
+                return false;
+            }
+            data += n;
+            size -= n;
+            write_offset_ += n;
+        }
+        buffered_ = 0;
+        return true;
+    }
+
+    // Fall back to buffered writes. Returns "false" if O_DIRECT was not set.
+    bool ClearDirect() {
+        const int flags = fcntl(fd_, F_GETFL);
+        if (flags == -1 || (flags & O_DIRECT) == 0) {
+            return false;
+        }
+        HLOGW("Zip: O_DIRECT write refused, writing through the page cache");
+        return fcntl(fd_, F_SETFL, flags & ~O_DIRECT) == 0;
+    }
+
+    const int fd_;
+    uint8_t *const buffer_;
+    const off64_t start_offset_;
+    const size_t declared_length_;
+    size_t total_bytes_written_;
+
+    // Bytes gathered in |buffer_|, and where they go.
+    size_t buffered_;
+    off64_t write_offset_;
+};
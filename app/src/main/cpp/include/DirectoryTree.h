@@ -0,0 +1,125 @@
+//
+// Created by season on 2021/7/6.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Macros.h"
+#include "ZipString.h"
+#include "EntryIndex.h"
+
+namespace hms {
+    // One node of an archive's directory view, as returned by
+    // ZipFile::ListDirectory and ZipFile::Stat.
+    struct ZipDirEntry {
+        // Path of this node from the root of the archive, without a trailing
+        // slash. Points into the central directory.
+        ZipString path;
+
+        // Last component of |path|.
+        ZipString name;
+
+        bool is_directory;
+
+        // True if no entry in the archive has this path: the directory only
+        // exists because some entry lives beneath it.
+        bool is_synthetic;
+
+        // Number of direct children, 0 for files.
+        uint32_t child_count;
+
+        // Position of the node's entry in the archive's entry index, for
+        // ZipFile::FindEntryByIndex, or -1 if |is_synthetic|.
+        int32_t entry_index;
+
+        // Uncompressed size of a file, 0 for directories.
+        uint32_t uncompressed_length;
+    };
+
+    /*
+     * Directory hierarchy of an archive, derived from its entry names.
+     *
+     * Every path component becomes a node; directories that have no entry of
+     * their own ("res/" when only "res/raw/a.png" is stored) are synthesized.
+     * Empty components are ignored, so "/res//a.png" is "res/a.png". When
+     * several entries come down to the same path, the node refers to the
+     * first of them in name order; the others are only found by FindEntry.
+     * The children of a node are kept sorted by name, so a path is resolved
+     * with one binary search per component and a listing costs O(children).
+     * Names are never copied, nodes point into the central directory.
+     */
+    class DirectoryTree {
+    public:
+        DirectoryTree() = default;
+
+        /*
+         * Build the tree from |index|, visiting entries in the name order given
+         * by |sorted_entries|.
+         */
+        void Build(const EntryIndex &index, const std::vector<uint16_t> &sorted_entries);
+
+        /*
+         * Resolve |path|. Empty components are ignored, so "", "/" and "res//"
+         * name the root and "res" respectively.
+         *
+         * Returns the node index, or -1 if there is no such path.
+         */
+        int32_t Lookup(const ZipString &path) const;
+
+        bool IsDirectory(uint32_t node) const { return nodes_[node].is_directory; }
+
+        void GetDirEntry(uint32_t node, ZipDirEntry *out) const;
+
+        void ListChildren(uint32_t node, std::vector<ZipDirEntry> *out) const;
+
+    private:
+        struct Node {
+            const uint8_t *path;
+            uint16_t path_length;
+            // Offset of the last component within |path|.
+            uint16_t name_offset;
+            bool is_directory;
+            bool is_synthetic;
+            int32_t entry_index;
+            uint32_t uncompressed_length;
+            std::vector<uint32_t> children;
+
+            ZipString GetName() const {
+                ZipString name;
+                name.name = path + name_offset;
+                name.name_length = path_length - name_offset;
+                return name;
+            }
+        };
+
+        // Add a node for entry |ent|, or a synthetic directory if |ent| is -1.
+        // Identifies a node while the tree is built. A file and a directory
+        // may share a name.
+        struct ChildKey {
+            uint32_t parent;
+            bool is_directory;
+            ZipString name;
+
+            bool operator<(const ChildKey &rhs) const {
+                if (parent != rhs.parent) {
+                    return parent < rhs.parent;
+                }
+                if (is_directory != rhs.is_directory) {
+                    return is_directory < rhs.is_directory;
+                }
+                return name < rhs.name;
+            }
+        };
+
+        uint32_t AddNode(uint32_t parent, const uint8_t *path, uint16_t name_offset,
+                         uint16_t path_length, bool is_directory, int32_t ent,
+                         uint32_t uncompressed_length);
+
+        std::vector<Node> nodes_;
+
+        DISALLOW_COPY_AND_ASSIGN(DirectoryTree);
+    };
+}
@@ -0,0 +1,26 @@
+//
+// Created by season on 2021/7/13.
+//
+
+#pragma once
+#include "Writer.h"
+
+// Accepts up to the declared length of an entry and drops it. Lets an entry
+// be decompressed and checked without a destination.
+class DiscardWriter : public Writer {
+public:
+    explicit DiscardWriter(size_t declared_length)
+            : declared_length_(declared_length), total_bytes_written_(0) {}
+
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
+        if (total_bytes_written_ + buf_size > declared_length_) {
+            return false;
+        }
+        total_bytes_written_ += buf_size;
+        return true;
+    }
+
+private:
+    const size_t declared_length_;
+    size_t total_bytes_written_;
+};
@@ -0,0 +1,134 @@
+//
+// Created by season on 2021/7/4.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Macros.h"
+#include "ZipString.h"
+#include "ZipFileCommon.h"
+
+namespace hms {
+    /*
+     * Structure-of-arrays index over the central directory.
+     *
+     * The open-addressed hash table is two parallel slot arrays: the full
+     * 32-bit hash of each name and the index of its entry (6 bytes a slot,
+     * against 16 for a ZipString). Probes compare the stored hash before
+     * looking at any name bytes. Per entry, only the offset of its central
+     * directory record is kept, in central directory order; the other fields
+     * are read from that record, which stays mapped, rather than duplicated.
+     *
+     * All arrays live in one contiguous block, so the index can be written to
+     * and mapped back from an index cache without any fix-ups.
+     */
+    class EntryIndex {
+    public:
+        static const uint16_t kEmptySlot = 0xffff;
+
+        EntryIndex();
+
+        ~EntryIndex();
+
+        /*
+         * Size in bytes of the block backing an index of |num_entries| entries
+         * with |table_size| hash slots.
+         */
+        static size_t ByteSize(uint16_t num_entries, uint32_t table_size);
+
+        static uint32_t ComputeHash(const uint8_t *name, uint16_t length);
+
+        /*
+         * Allocate an empty, owned index for |num_entries| entries over the
+         * central directory at |cd_ptr|.
+         *
+         * Returns "false" on failure.
+         */
+        bool Allocate(const uint8_t *cd_ptr, uint16_t num_entries);
+
+        /*
+         * Use the |size| bytes at |data|, as produced by GetData() for an
+         * identical central directory at |cd_ptr|, without copying them.
+         * |data| must outlive this index. The offsets are bounds checked
+         * against |cd_size|, and exactly |num_entries| slots must be in use,
+         * so that a corrupt block is rejected rather than trusted.
+         *
+         * Returns "false" if the block is malformed.
+         */
+        bool Attach(const uint8_t *cd_ptr, size_t cd_size, const void *data, size_t size,
+                    uint16_t num_entries, uint32_t table_size);
+
+        /*
+         * Add the entry described by the central directory record at |cdr|.
+         *
+         * Returns "false" if an entry with the same name is already present.
+         */
+        bool Add(const CentralDirectoryRecord *cdr);
+
+        /*
+         * Returns the index of the entry called |name|, or -1 if none.
+         */
+        int32_t Find(const ZipString &name) const;
+
+        bool IsValid() const { return data_ != nullptr; }
+
+        const void *GetData() const { return data_; }
+
+        size_t GetDataSize() const { return ByteSize(num_entries_, table_size_); }
+
+        uint16_t GetNumEntries() const { return num_entries_; }
+
+        uint32_t GetTableSize() const { return table_size_; }
+
+        ZipString GetName(uint32_t idx) const {
+            ZipString name;
+            name.name = cd_ptr_ + cd_offsets_[idx] + sizeof(CentralDirectoryRecord);
+            name.name_length = GetRecord(idx)->file_name_length;
+            return name;
+        }
+
+        const CentralDirectoryRecord *GetRecord(uint32_t idx) const {
+            return reinterpret_cast<const CentralDirectoryRecord *>(cd_ptr_ + cd_offsets_[idx]);
+        }
+
+        uint16_t GetMethod(uint32_t idx) const { return GetRecord(idx)->compression_method; }
+
+        uint32_t GetCrc32(uint32_t idx) const { return GetRecord(idx)->crc32; }
+
+        uint32_t GetCompressedLength(uint32_t idx) const {
+            return GetRecord(idx)->compressed_size;
+        }
+
+        uint32_t GetUncompressedLength(uint32_t idx) const {
+            return GetRecord(idx)->uncompressed_size;
+        }
+
+        uint32_t GetLocalHeaderOffset(uint32_t idx) const {
+            return GetRecord(idx)->local_file_header_offset;
+        }
+
+    private:
+        void Layout(uint8_t *base);
+
+        const uint8_t *cd_ptr_;
+        void *owned_;
+        const void *data_;
+        uint16_t num_entries_;
+        uint16_t num_added_;
+        uint32_t table_size_;
+
+        // Per-slot arrays, |table_size_| long.
+        uint32_t *slot_hashes_;
+        uint16_t *slot_entries_;
+
+        // Per-entry array, |num_entries_| long, relative to the start of the
+        // central directory.
+        uint32_t *cd_offsets_;
+
+        DISALLOW_COPY_AND_ASSIGN(EntryIndex);
+    };
+}
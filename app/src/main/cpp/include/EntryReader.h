@@ -0,0 +1,99 @@
+//
+// Created by season on 2021/7/15.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "InflateContext.h"
+#include "MappedZipFile.h"
+#include "Macros.h"
+
+namespace hms {
+    /*
+     * Pulls the uncompressed bytes of one entry, as opened by
+     * ZipFile::OpenEntryReader. Deflated data is inflated on demand through
+     * a window of InflateContext::kBufferSize bytes, so reading the start of
+     * a large entry costs only that start and memory use does not grow with
+     * the entry. Once the last byte has been read or skipped, the entry is
+     * checked against its declared length and, with OpenOptions::verify_crc,
+     * its CRC-32.
+     *
+     * A reader is used by one thread at a time and must not outlive the
+     * ZipFile that opened it.
+     */
+    class EntryReader {
+    public:
+        EntryReader() { Reset(); }
+
+        /*
+         * Copy up to |len| bytes of the entry to |buf|.
+         *
+         * Returns the number of bytes copied, 0 at the end of the entry, or a
+         * negative error code, which every later call returns as well.
+         */
+        int64_t Read(void *buf, size_t len);
+
+        /*
+         * Move |len| bytes further into the entry, without copying them.
+         * Deflated data, and stored data whose CRC is checked, is still
+         * decompressed or read on the way.
+         *
+         * Returns the number of bytes skipped or a negative error code.
+         */
+        int64_t Skip(uint64_t len);
+
+        // Bytes of the entry not read or skipped yet.
+        uint64_t Remaining() const { return remaining_; }
+
+        bool IsValid() const { return zip_ != nullptr; }
+
+        // Close the reader, handing its InflateContext back.
+        void Reset();
+
+    private:
+        friend class ZipFile;
+
+        // Read or skip (|out| is |nullptr|) |len| bytes.
+        int64_t Consume(uint8_t *out, uint64_t len);
+
+        // Decompress or read the next |len| bytes of the entry to |out|.
+        int32_t Produce(uint8_t *out, size_t len);
+
+        // Inflate to |out| until it holds |len| bytes or the stream ends.
+        int32_t Inflate(uint8_t *out, size_t len, size_t *produced);
+
+        // Check the entry once all of it has been produced.
+        int32_t Finish();
+
+        const MappedZipFile *zip_;
+        InflateContextPool::Handle context_;
+        bool deflated_;
+        bool check_crc_;
+        uint32_t expected_crc_;
+
+        // The entry's data, if the archive is addressable.
+        const uint8_t *mapped_;
+
+        // Archive offset and length of the data not read yet.
+        off64_t input_offset_;
+        uint64_t input_remaining_;
+        bool stream_end_;
+
+        // Bytes not produced yet, and not handed to the caller yet.
+        uint64_t unproduced_;
+        uint64_t remaining_;
+
+        // Produced bytes waiting in the window.
+        const uint8_t *window_;
+        size_t window_avail_;
+
+        uint32_t crc_;
+        int32_t error_;
+
+        DISALLOW_COPY_AND_ASSIGN(EntryReader);
+    };
+}
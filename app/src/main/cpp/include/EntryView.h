@@ -0,0 +1,45 @@
+//
+// Created by season on 2021/7/9.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+#include "FileMap.h"
+
+namespace hms {
+    /*
+     * Read-only view of the bytes of a stored entry, as returned by
+     * ZipFile::OpenEntryView. The view holds a reference on the mapping it
+     * points into, so it stays valid after the ZipFile is closed and can be
+     * copied and handed to other threads freely.
+     */
+    class EntryView {
+    public:
+        EntryView() : data_(nullptr), length_(0) {}
+
+        const uint8_t *GetData() const { return data_; }
+
+        size_t GetLength() const { return length_; }
+
+        bool IsValid() const { return data_ != nullptr; }
+
+        // Drop the reference on the mapping.
+        void Reset() {
+            map_.reset();
+            data_ = nullptr;
+            length_ = 0;
+        }
+
+    private:
+        friend class ZipFile;
+
+        // |nullptr| for archives opened from memory, which the caller owns.
+        std::shared_ptr<FileMap> map_;
+        const uint8_t *data_;
+        size_t length_;
+    };
+}
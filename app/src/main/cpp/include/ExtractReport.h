@@ -0,0 +1,75 @@
+//
+// Created by season on 2021/7/8.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "ZipString.h"
+
+namespace hms {
+    // Outcome of extracting one entry in a ZipFile::ExtractAll batch.
+    struct ExtractResult {
+        // Position of the entry in the archive's entry index.
+        uint32_t index;
+
+        // Name of the entry. Points into the central directory.
+        ZipString name;
+
+        // 0 on success, or one of the negative ZipFile error codes.
+        int32_t error;
+
+        // Bytes written to the destination file.
+        uint64_t bytes_written;
+
+        // The destination already held the entry and was left alone, see
+        // ExtractOptions::skip_unchanged.
+        bool skipped;
+    };
+
+    // Summary of a ZipFile::ExtractAll batch.
+    struct ExtractReport {
+        // One result per entry accepted by the filter, in central directory
+        // order.
+        std::vector<ExtractResult> results;
+
+        uint32_t num_extracted;
+        uint32_t num_failed;
+        // Entries whose destination already held them.
+        uint32_t num_skipped;
+        uint64_t bytes_written;
+
+        ExtractReport() : num_extracted(0), num_failed(0), num_skipped(0), bytes_written(0) {}
+    };
+
+    // Outcome of checking one entry in a ZipFile::VerifyAll batch.
+    struct VerifyResult {
+        // Position of the entry in the archive's entry index.
+        uint32_t index;
+
+        // Name of the entry. Points into the central directory.
+        ZipString name;
+
+        // 0 if the entry is intact, kCancelled if it was not checked, or
+        // another negative ZipFile error code.
+        int32_t error;
+    };
+
+    // Summary of a ZipFile::VerifyAll batch.
+    struct VerifyReport {
+        // One result per entry accepted by the filter, in central directory
+        // order.
+        std::vector<VerifyResult> results;
+
+        uint32_t num_verified;
+        uint32_t num_failed;
+        // Entries left unchecked after VerifyOptions::stop_on_failure fired.
+        uint32_t num_skipped;
+        // Uncompressed bytes of the entries found intact.
+        uint64_t bytes_verified;
+
+        VerifyReport() : num_verified(0), num_failed(0), num_skipped(0), bytes_verified(0) {}
+    };
+}
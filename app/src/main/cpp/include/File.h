@@ -17,6 +17,7 @@
 #pragma once
 
 #include <sys/stat.h>
+#include <sys/types.h>
 #include <string>
 
 #if !defined(O_BINARY)
@@ -29,5 +30,30 @@ namespace hms {
         static bool WriteFully(int fd, const void *data, size_t byte_count);
 
         static std::string Dirname(const std::string &path);
+
+        // Create a new file with a unique name next to |path|, to be renamed
+        // over it once written, and store its name in |tmp_path|. Returns its
+        // descriptor, open for writing with mode 0600, or -1 on failure.
+        static int CreateTemp(const std::string &path, std::string *tmp_path);
+
+        // Create |path| and any missing parents. Returns "true" if |path| is a
+        // directory afterwards, including when another thread created it.
+        static bool MakeDirs(const std::string &path);
+
+        // Open the directory |path|, relative to |dir_fd|, one component at
+        // a time without following symbolic links, creating missing ones if
+        // |create| is set. Empty components are skipped, so "" opens |dir_fd|
+        // again. Returns a new descriptor, or -1 with errno set: ELOOP if a
+        // component is a symbolic link.
+        static int OpenDirBeneath(int dir_fd, const std::string &path, bool create);
+
+        // Write back the dirty pages of the |length| bytes at |offset| of
+        // |fd|: start the writes, or with |wait| also wait for them and for
+        // earlier ones. Returns "false" on failure.
+        static bool SyncRange(int fd, off64_t offset, off64_t length, bool wait);
+
+        // Write back and then drop from the page cache the |length| bytes at
+        // |offset| of |fd|. Returns "false" on failure.
+        static bool DropRange(int fd, off64_t offset, off64_t length);
     };
 }
@@ -9,6 +9,10 @@
 namespace hms {
     class FileMap {
     public:
+        enum MapAdvice {
+            NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED
+        };
+
         FileMap(void);
 
         FileMap(FileMap &&f);
@@ -43,6 +47,19 @@ namespace hms {
          */
         size_t getDataLength(void) const { return mDataLength; }
 
+        /*
+         * Advise the kernel how the whole mapping is going to be accessed.
+         *
+         * Returns 0 on success, -1 on failure.
+         */
+        int advise(MapAdvice advice);
+
+        /*
+         * As above, for the |length| bytes at |offset| from the start of the
+         * requested data. The range is widened to whole pages.
+         */
+        int advise(MapAdvice advice, size_t offset, size_t length);
+
     protected:
 
     private:
@@ -3,6 +3,8 @@
 //
 
 #pragma once
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 #include "Writer.h"
 #include <cstdlib>
 #include <HLog.h>
@@ -16,13 +18,35 @@ public:
     // is truncated to the correct length (no truncation if |fd| references a
     // block device).
     //
+    // With |drop_cache|, the data is written back as it is written and then
+    // dropped from the page cache, kWriteBehindChunk bytes at a time, so a
+    // large entry leaves at most two chunks of its pages in the cache.
+    //
     // Returns a valid FileWriter on success, |nullptr| if an error occurred.
-    static std::unique_ptr<FileWriter> Create(int fd, const ZipEntry *entry) {
+    static std::unique_ptr<FileWriter> Create(int fd, const ZipEntry *entry,
+                                              bool drop_cache = false) {
+        off64_t current_offset;
+        bool reserved;
+        if (!Prepare(fd, entry, &current_offset, &reserved)) {
+            return std::unique_ptr<FileWriter>(nullptr);
+        }
+
+        return std::unique_ptr<FileWriter>(
+                new FileWriter(fd, entry->uncompressed_length, current_offset, drop_cache));
+    }
+
+    // Sizes the file behind |fd| for |entry| as described above. On success
+    // |current_offset| is where the entry will start and |reserved| tells
+    // whether fallocate guaranteed the disk space for it.
+    //
+    // Returns "false" if an error occurred.
+    static bool Prepare(int fd, const ZipEntry *entry, off64_t *current_offset, bool *reserved) {
         const uint32_t declared_length = entry->uncompressed_length;
-        const off64_t current_offset = lseek64(fd, 0, SEEK_CUR);
-        if (current_offset == -1) {
+        *current_offset = lseek64(fd, 0, SEEK_CUR);
+        *reserved = false;
+        if (*current_offset == -1) {
             HLOGW("Zip: unable to seek to current location on fd %d: %s", fd, strerror(errno));
-            return nullptr;
+            return false;
         }
 
         int result = 0;
@@ -41,9 +65,10 @@ public:
             __system_property_get("ro.build.version.sdk", sdkVersion);
             const int sdkVersionInt = atoi(sdkVersion);
             if (sdkVersionInt > __ANDROID_API_L__) {
-                result = TEMP_FAILURE_RETRY(fallocate(fd, 0, current_offset, declared_length));
+                result = TEMP_FAILURE_RETRY(fallocate(fd, 0, *current_offset, declared_length));
+                *reserved = result == 0;
             } else {
-                result = TEMP_FAILURE_RETRY(ftruncate(fd, declared_length + current_offset));
+                result = TEMP_FAILURE_RETRY(ftruncate(fd, declared_length + *current_offset));
             }
 
             if (result == -1 && errno == ENOSPC) {
@@ -52,9 +77,9 @@ public:
                               " bytes at offset %"
                               PRId64
                               " : %s",
-                      static_cast<int64_t>(declared_length), static_cast<int64_t>(current_offset),
+                      static_cast<int64_t>(declared_length), static_cast<int64_t>(*current_offset),
                       strerror(errno));
-                return std::unique_ptr<FileWriter>(nullptr);
+                return false;
             }
         }
 #endif  // __linux__
@@ -62,25 +87,25 @@ public:
         struct stat sb;
         if (fstat(fd, &sb) == -1) {
             HLOGW("Zip: unable to fstat file: %s", strerror(errno));
-            return std::unique_ptr<FileWriter>(nullptr);
+            return false;
         }
 
         // Block device doesn't support ftruncate(2).
         if (!S_ISBLK(sb.st_mode)) {
-            result = TEMP_FAILURE_RETRY(ftruncate(fd, declared_length + current_offset));
+            result = TEMP_FAILURE_RETRY(ftruncate(fd, declared_length + *current_offset));
             if (result == -1) {
                 HLOGW("Zip: unable to truncate file to %"
                 PRId64
                 ": %s",
-                        static_cast<int64_t>(declared_length + current_offset), strerror(errno));
-                return std::unique_ptr<FileWriter>(nullptr);
+                        static_cast<int64_t>(declared_length + *current_offset), strerror(errno));
+                return false;
             }
         }
 
-        return std::unique_ptr<FileWriter>(new FileWriter(fd, declared_length));
+        return true;
     }
 
-    virtual bool Append(uint8_t *buf, size_t buf_size) override {
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
         if (total_bytes_written_ + buf_size > declared_length_) {
             HLOGW("Zip: Unexpected size "
             ZD
@@ -94,6 +119,9 @@ public:
         const bool result = hms::File::WriteFully(fd_, buf, buf_size);
         if (result) {
             total_bytes_written_ += buf_size;
+            if (drop_cache_) {
+                WriteBehind(false);
+            }
         } else {
             HLOGW("Zip: unable to write "
             ZD
@@ -103,12 +131,106 @@ public:
         return result;
     }
 
+    virtual ssize_t CopyFileRange(int in_fd, off64_t offset, size_t length) override {
+        if (total_bytes_written_ + length > declared_length_) {
+            return 0;  // Let Append report the bogus length.
+        }
+
+        size_t copied = 0;
+        bool use_copy_file_range = true;
+        while (copied < length) {
+            ssize_t n = -1;
+#if defined(__NR_copy_file_range)
+            if (use_copy_file_range) {
+                // Called through syscall(2): bionic only wraps it from API 34.
+                loff_t in_off = offset + copied;
+                n = TEMP_FAILURE_RETRY(syscall(__NR_copy_file_range, in_fd, &in_off, fd_, nullptr,
+                                               length - copied, 0));
+                if (n == -1 && IsCopyUnsupported(errno)) {
+                    use_copy_file_range = false;
+                    continue;
+                }
+            } else
+#endif
+            {
+                off64_t in_off = offset + copied;
+                n = TEMP_FAILURE_RETRY(sendfile64(fd_, in_fd, &in_off, length - copied));
+                if (n == -1 && IsCopyUnsupported(errno)) {
+                    break;
+                }
+            }
+
+            if (n == -1) {
+                HLOGW("Zip: unable to copy " ZD " bytes to file: %s",
+                      length - copied, strerror(errno));
+                return -1;
+            }
+            if (n == 0) {
+                // Unexpected end of the archive; Append will report it.
+                break;
+            }
+            copied += n;
+        }
+
+        total_bytes_written_ += copied;
+        if (drop_cache_) {
+            WriteBehind(false);
+        }
+        return copied;
+    }
+
+    virtual bool Flush() override {
+        if (drop_cache_) {
+            WriteBehind(true);
+        }
+        return true;
+    }
+
+    static const off64_t kWriteBehindChunk = 8 * 1024 * 1024;
+
 private:
-    FileWriter(const int fd, const size_t declared_length)
-            : Writer(), fd_(fd), declared_length_(declared_length), total_bytes_written_(0) {}
+    // Start the write-back of each completed chunk, then wait for the one
+    // before it and drop it, so that writing keeps the disk busy. With
+    // |final|, write back and drop everything left. Failures only leave
+    // pages in the cache.
+    void WriteBehind(bool final) {
+        const off64_t end = start_offset_ + static_cast<off64_t>(total_bytes_written_);
+        while (end - synced_ >= kWriteBehindChunk) {
+            hms::File::SyncRange(fd_, synced_, kWriteBehindChunk, false);
+            if (dropped_ < synced_) {
+                hms::File::DropRange(fd_, dropped_, synced_ - dropped_);
+                dropped_ = synced_;
+            }
+            synced_ += kWriteBehindChunk;
+        }
+        if (final && dropped_ < end) {
+            hms::File::DropRange(fd_, dropped_, end - dropped_);
+            dropped_ = synced_ = end;
+        }
+    }
+
+    // Errors meaning the kernel can't do this particular copy, as opposed
+    // to I/O errors.
+    static bool IsCopyUnsupported(int error) {
+        return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP ||
+               error == EPERM || error == EBADF;
+    }
+
+    FileWriter(const int fd, const size_t declared_length, off64_t start_offset,
+               bool drop_cache)
+            : Writer(), fd_(fd), declared_length_(declared_length), total_bytes_written_(0),
+              start_offset_(start_offset), drop_cache_(drop_cache), synced_(start_offset),
+              dropped_(start_offset) {}
 
     const int fd_;
     const size_t declared_length_;
     size_t total_bytes_written_;
+
+    // Where the entry starts, and up to where write-back has been started
+    // and the cache dropped.
+    const off64_t start_offset_;
+    const bool drop_cache_;
+    off64_t synced_;
+    off64_t dropped_;
 };
 
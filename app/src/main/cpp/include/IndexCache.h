@@ -0,0 +1,83 @@
+//
+// Created by season on 2021/7/3.
+//
+
+#pragma once
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <memory>
+
+#include "EntryIndex.h"
+#include "FileMap.h"
+
+namespace hms {
+    // Header of the central directory index cache. The cache is a private,
+    // per-device file so all fields are stored in native byte order.
+    struct IndexCacheHeader {
+        static const uint32_t kMagic = 0x5844495a;  // "ZIDX"
+        static const uint32_t kVersion = 3;
+
+        uint32_t magic;
+        uint32_t version;
+        // Identity of the archive the cache was built from.
+        uint64_t archive_inode;
+        uint64_t archive_size;
+        int64_t archive_mtime_sec;
+        int64_t archive_mtime_nsec;
+        // Location and CRC-32 of the central directory the cache indexes.
+        uint32_t cd_start_offset;
+        uint32_t cd_size;
+        uint32_t cd_crc32;
+        uint16_t num_entries;
+        uint16_t reserved;
+        uint32_t hash_table_size;
+        // CRC-32 of the EntryIndex block that follows.
+        uint32_t index_crc32;
+    } __attribute__((packed));
+
+    // The EntryIndex block follows the header and needs 4-byte alignment.
+    static_assert(sizeof(IndexCacheHeader) % sizeof(uint32_t) == 0,
+                  "IndexCacheHeader breaks EntryIndex alignment");
+
+    class IndexCache {
+    public:
+        /*
+         * Map the cache at |path| and check that it was written for the archive
+         * described by |sb|. The central directory checksum is not verified
+         * here since that requires the directory to be mapped.
+         *
+         * Returns |nullptr| if the cache is missing, malformed or stale.
+         */
+        static std::unique_ptr<IndexCache> Open(const char *path, const struct stat &sb);
+
+        /*
+         * Atomically replace the cache at |path| with |header| followed by the
+         * backing block of |index|.
+         *
+         * Returns "false" on failure.
+         */
+        static bool Write(const char *path, const IndexCacheHeader &header,
+                          const EntryIndex &index);
+
+        static void FillArchiveIdentity(const struct stat &sb, IndexCacheHeader *header);
+
+        const IndexCacheHeader *GetHeader() const {
+            return reinterpret_cast<const IndexCacheHeader *>(map_.getDataPtr());
+        }
+
+        const void *GetIndexData() const {
+            return GetHeader() + 1;
+        }
+
+        size_t GetIndexDataSize() const {
+            return map_.getDataLength() - sizeof(IndexCacheHeader);
+        }
+
+    private:
+        IndexCache() = default;
+
+        FileMap map_;
+    };
+}
@@ -0,0 +1,88 @@
+//
+// Created by season on 2021/7/10.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "zlib.h"
+#include "Macros.h"
+
+namespace hms {
+    /*
+     * A zlib stream set up for raw deflate data, together with the read and
+     * write buffers an extraction needs. Contexts are recycled through an
+     * InflateContextPool so that extracting an entry does not allocate.
+     */
+    class InflateContext {
+    public:
+        // Big enough that most entries fit in one buffer and can be
+        // inflated in a single call.
+        static const size_t kBufferSize = 65536;
+
+        // Page aligned, so the buffers also suit O_DIRECT I/O.
+        static const size_t kBufferAlignment = 4096;
+
+        ~InflateContext();
+
+        z_stream *GetStream() { return &stream_; }
+
+        uint8_t *GetReadBuffer() { return buffers_; }
+
+        uint8_t *GetWriteBuffer() { return buffers_ + kBufferSize; }
+
+    private:
+        friend class InflateContextPool;
+
+        InflateContext() : buffers_(nullptr) {}
+
+        // Returns "false" if zlib or the allocation failed.
+        bool Init();
+
+        // Make the stream ready for a new entry. Returns "false" on failure.
+        bool Reset();
+
+        z_stream stream_;
+        uint8_t *buffers_;
+
+        DISALLOW_COPY_AND_ASSIGN(InflateContext);
+    };
+
+    // Hands out InflateContexts to any number of threads.
+    class InflateContextPool {
+    private:
+        struct Releaser {
+            InflateContextPool *pool;
+
+            void operator()(InflateContext *context) const { pool->Release(context); }
+        };
+
+    public:
+        typedef std::unique_ptr<InflateContext, Releaser> Handle;
+
+        InflateContextPool() = default;
+
+        ~InflateContextPool();
+
+        /*
+         * Take a context out of the pool, creating one if all are in use. It
+         * goes back to the pool when |handle| is destroyed.
+         *
+         * Returns "false" if a new context could not be set up.
+         */
+        bool Acquire(Handle *handle);
+
+    private:
+        void Release(InflateContext *context);
+
+        std::mutex lock_;
+        std::vector<InflateContext *> free_;
+
+        DISALLOW_COPY_AND_ASSIGN(InflateContextPool);
+    };
+}
@@ -0,0 +1,114 @@
+//
+// Created by season on 2021/7/13.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+#include "Macros.h"
+
+namespace hms {
+    /*
+     * A small io_uring instance driven by raw system calls. Requests queued
+     * with Prepare* reach the kernel in batches, with the next Submit or
+     * Wait, and are identified by the token Prepare* returns.
+     *
+     * A ring is not thread-safe; each thread uses its own (ForThisThread),
+     * together with the staging buffers it carries for one ChunkReader and
+     * one UringFileWriter at a time.
+     */
+    class IoUring {
+    public:
+        static const unsigned kQueueDepth = 32;
+
+        // Buffers a UringFileWriter copies data into while earlier writes
+        // are in flight, and the read-ahead buffer of a ChunkReader.
+        static const unsigned kNumWriteBuffers = 4;
+        static const size_t kBufferSize = 65536;
+
+        /*
+         * The ring of the calling thread, set up on its first use and closed
+         * when the thread exits. Returns |nullptr| when io_uring is not
+         * available: kernels before 5.6 (no IORING_OP_READ / WRITE), or a
+         * seccomp policy that blocks it, as Android's app sandbox does.
+         */
+        static IoUring *ForThisThread();
+
+        ~IoUring();
+
+        // Queue a read of |len| bytes at |off| of |fd| into |buf|. Returns
+        // the request token, or 0 if the ring failed.
+        uint64_t PrepareRead(int fd, void *buf, size_t len, off64_t off);
+
+        // Queue a write of the |len| bytes at |buf| to |fd| at |off|.
+        uint64_t PrepareWrite(int fd, const void *buf, size_t len, off64_t off);
+
+        // Hand the queued requests to the kernel without waiting for them.
+        // Returns "false" on failure.
+        bool Submit();
+
+        /*
+         * Wait for the request |token|, submitting queued ones first, and set
+         * |result| to its outcome: bytes transferred, or -errno.
+         *
+         * Returns "false" if the ring itself failed.
+         */
+        bool Wait(uint64_t token, int32_t *result);
+
+        uint8_t *GetWriteBuffer(unsigned i) { return buffers_ + i * kBufferSize; }
+
+        uint8_t *GetReadAheadBuffer() { return buffers_ + kNumWriteBuffers * kBufferSize; }
+
+    private:
+        struct Completion {
+            uint64_t token;
+            int32_t result;
+        };
+
+        IoUring();
+
+        bool Init();
+
+        void *GetSqe();
+
+        uint64_t Queue(void *sqe);
+
+        bool Enter(unsigned min_complete);
+
+        void Reap();
+
+        int ring_fd_;
+
+        void *sq_ring_;
+        size_t sq_ring_size_;
+        void *cq_ring_;
+        size_t cq_ring_size_;
+        void *sqes_;
+        size_t sqes_size_;
+
+        uint32_t *sq_head_;
+        uint32_t *sq_tail_;
+        uint32_t sq_mask_;
+        uint32_t sq_entries_;
+        uint32_t *sq_array_;
+        uint32_t *cq_head_;
+        uint32_t *cq_tail_;
+        uint32_t cq_mask_;
+        void *cqes_;
+
+        // Requests queued since the last io_uring_enter.
+        uint32_t to_submit_;
+        uint64_t next_token_;
+
+        // Completions reaped while waiting for another request.
+        std::vector<Completion> completed_;
+
+        uint8_t *buffers_;
+
+        DISALLOW_COPY_AND_ASSIGN(IoUring);
+    };
+}
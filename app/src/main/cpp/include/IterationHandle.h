@@ -10,13 +10,21 @@
 namespace hms {
     class IterationHandle {
     public:
+        // Next candidate in [begin, end). These are entry indices, or positions
+        // in the archive's sorted name index if |sorted| is set.
         uint32_t position;
+        uint32_t begin;
+        uint32_t end;
+        bool sorted;
+        // Whether Next skips local file header validation.
+        bool metadata_only;
         // We're not using vector here because this code is used in the Windows SDK
         // where the STL is not available.
         ZipString prefix;
         ZipString suffix;
 
-        IterationHandle(const ZipString *in_prefix, const ZipString *in_suffix) {
+        IterationHandle(const ZipString *in_prefix, const ZipString *in_suffix)
+                : position(0), begin(0), end(0), sorted(false), metadata_only(false) {
             if (in_prefix) {
                 uint8_t *name_copy = new uint8_t[in_prefix->name_length];
                 memcpy(name_copy, in_prefix->name, in_prefix->name_length);
@@ -0,0 +1,79 @@
+//
+// Created by season on 2021/7/9.
+//
+
+#pragma once
+#include <fcntl.h>
+#include "FileWriter.h"
+#include "FileMap.h"
+
+class MappedFileWriter : public Writer {
+public:
+    // Creates a MappedFileWriter for |fd|, sized for |entry| like a FileWriter,
+    // that maps the destination range so the entry can be produced directly
+    // in the page cache, without an intermediate buffer or write() calls.
+    //
+    // |fd| must be open O_RDWR, since a shared writable mapping needs read
+    // access too. The writer is only created when fallocate reserved the
+    // disk space: storing to a mapping of a sparse file on a full volume
+    // raises SIGBUS instead of failing with ENOSPC.
+    //
+    // Returns |nullptr| whenever a FileWriter should be used instead.
+    static std::unique_ptr<MappedFileWriter> Create(int fd, const ZipEntry *entry) {
+        const size_t declared_length = entry->uncompressed_length;
+        const int flags = fcntl(fd, F_GETFL);
+        if (declared_length == 0 || flags == -1 || (flags & O_ACCMODE) != O_RDWR) {
+            return std::unique_ptr<MappedFileWriter>(nullptr);
+        }
+
+        off64_t current_offset;
+        bool reserved;
+        if (!FileWriter::Prepare(fd, entry, &current_offset, &reserved) || !reserved) {
+            return std::unique_ptr<MappedFileWriter>(nullptr);
+        }
+
+        std::unique_ptr<hms::FileMap> map(new hms::FileMap());
+        if (!map->create(nullptr, fd, current_offset, declared_length, false)) {
+            return std::unique_ptr<MappedFileWriter>(nullptr);
+        }
+        map->advise(hms::FileMap::SEQUENTIAL);
+
+        // Leave the file offset after the entry, as writing it would have.
+        if (lseek64(fd, current_offset + declared_length, SEEK_SET) == -1) {
+            HLOGW("Zip: unable to seek past entry on fd %d: %s", fd, strerror(errno));
+            return std::unique_ptr<MappedFileWriter>(nullptr);
+        }
+
+        return std::unique_ptr<MappedFileWriter>(
+                new MappedFileWriter(std::move(map), declared_length));
+    }
+
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
+        if (total_bytes_written_ + buf_size > declared_length_) {
+            HLOGW("Zip: Unexpected size "
+            ZD
+            " (declared) vs "
+            ZD
+            " (actual)", declared_length_,
+                    total_bytes_written_ + buf_size);
+            return false;
+        }
+
+        memcpy(static_cast<uint8_t *>(map_->getDataPtr()) + total_bytes_written_, buf, buf_size);
+        total_bytes_written_ += buf_size;
+        return true;
+    }
+
+    virtual uint8_t *GetDirectBuffer() override {
+        return static_cast<uint8_t *>(map_->getDataPtr());
+    }
+
+private:
+    MappedFileWriter(std::unique_ptr<hms::FileMap> map, const size_t declared_length)
+            : Writer(), map_(std::move(map)), declared_length_(declared_length),
+              total_bytes_written_(0) {}
+
+    const std::unique_ptr<hms::FileMap> map_;
+    const size_t declared_length_;
+    size_t total_bytes_written_;
+};
@@ -3,18 +3,25 @@
 //
 
 #pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <memory>
+
+#include "FileMap.h"
+
 namespace hms {
     class MappedZipFile {
     public:
         explicit MappedZipFile(const int fd)
-                : has_fd_(true), fd_(fd), base_ptr_(nullptr), data_length_(0), read_pos_(0) {}
+                : has_fd_(true), fd_(fd), base_ptr_(nullptr), data_length_(0), archive_map_() {}
 
         explicit MappedZipFile(void *address, size_t length)
                 : has_fd_(false),
                   fd_(-1),
                   base_ptr_(address),
                   data_length_(static_cast<off64_t>(length)),
-                  read_pos_(0) {}
+                  archive_map_() {}
 
         bool HasFd() const { return has_fd_; }
 
@@ -24,11 +31,50 @@ namespace hms {
 
         off64_t GetFileLength() const;
 
-        bool SeekToOffset(off64_t offset);
+        // Reads |len| bytes at |off| into |buf|. This never uses or moves the
+        // file offset of the underlying descriptor, so any number of threads
+        // may read from the same MappedZipFile concurrently.
+        bool ReadAtOffset(uint8_t *buf, size_t len, off64_t off) const;
+
+        /*
+         * Map the whole archive read-only so that GetDataAt can serve the fd
+         * case too. Must be called before the archive is shared between
+         * threads. The archive must not be truncated while it is mapped, or
+         * reads of the lost pages raise SIGBUS.
+         *
+         * Returns "false" on failure, in which case reads keep using pread.
+         */
+        bool MapArchive(const char *name);
 
-        bool ReadData(uint8_t *buffer, size_t read_amount);
+        /*
+         * Returns a pointer to the |len| bytes at |off| if the archive is
+         * addressable (memory backed, or mapped by MapArchive) and the range is
+         * in bounds, and |nullptr| otherwise.
+         */
+        const uint8_t *GetDataAt(off64_t off, size_t len) const;
 
-        bool ReadAtOffset(uint8_t *buf, size_t len, off64_t off);
+        /*
+         * Hint that the |len| bytes at |off| are about to be read. No-op unless
+         * the archive was mapped by MapArchive.
+         */
+        void WillNeed(off64_t off, size_t len) const;
+
+        /*
+         * Hint that the |len| bytes at |off| are about to be read once, in
+         * order: ask for readahead of exactly that range, from the file or
+         * the mapping. No-op for archives in memory.
+         */
+        void WillReadOnce(off64_t off, size_t len) const;
+
+        /*
+         * Drop the |len| bytes at |off| from the page cache, and from the
+         * mapping made by MapArchive, once they have been read. Pages still
+         * mapped elsewhere stay. No-op for archives in memory.
+         */
+        void DontNeed(off64_t off, size_t len) const;
+
+        // The mapping made by MapArchive, or |nullptr|.
+        std::shared_ptr<FileMap> GetArchiveMap() const { return archive_map_; }
 
     private:
         // If has_fd_ is true, fd is valid and we'll read contents of a zip archive
@@ -41,10 +87,8 @@ namespace hms {
 
         void *const base_ptr_;
         const off64_t data_length_;
-        // read_pos_ is the offset to the base_ptr_ where we read data from.
-        size_t read_pos_;
 
-    private:
-        bool ReadFully(void *data, size_t byte_count);
+        // Mapping of the whole file made by MapArchive, if any.
+        std::shared_ptr<FileMap> archive_map_;
     };
 }
\ No newline at end of file
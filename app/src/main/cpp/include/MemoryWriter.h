@@ -0,0 +1,41 @@
+//
+// Created by season on 2021/7/16.
+//
+
+#pragma once
+#include <vector>
+#include "Writer.h"
+
+// Extracts an entry into a std::vector, which is cleared and reserved for
+// exactly the declared length so that it never grows in steps. Deflated
+// entries are inflated in place: the first GetDirectBuffer call sizes the
+// vector to the declared length.
+class MemoryWriter : public Writer {
+public:
+    MemoryWriter(std::vector<uint8_t> *out, size_t declared_length)
+            : out_(out), declared_length_(declared_length) {
+        out_->clear();
+        out_->reserve(declared_length_);
+    }
+
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
+        if (out_->size() + buf_size > declared_length_) {
+            return false;
+        }
+        out_->insert(out_->end(), buf, buf + buf_size);
+        return true;
+    }
+
+    virtual uint8_t *GetDirectBuffer() override {
+        if (declared_length_ == 0 || (out_->size() != declared_length_ && !out_->empty())) {
+            // Data was Appended already.
+            return nullptr;
+        }
+        out_->resize(declared_length_);
+        return out_->data();
+    }
+
+private:
+    std::vector<uint8_t> *const out_;
+    const size_t declared_length_;
+};
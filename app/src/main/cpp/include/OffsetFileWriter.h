@@ -0,0 +1,43 @@
+//
+// Created by season on 2021/7/16.
+//
+
+#pragma once
+#include <unistd.h>
+#include "Writer.h"
+
+// Writes an entry to |fd| at a given offset with pwrite, leaving the file
+// offset, its size and the data around the entry alone. Lets entries be
+// extracted into a slice of an existing file, such as a package being
+// assembled, or by several threads into one file.
+class OffsetFileWriter : public Writer {
+public:
+    OffsetFileWriter(int fd, off64_t offset, size_t declared_length)
+            : fd_(fd), offset_(offset), declared_length_(declared_length),
+              total_bytes_written_(0) {}
+
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
+        if (total_bytes_written_ + buf_size > declared_length_) {
+            return false;
+        }
+
+        while (buf_size > 0) {
+            const ssize_t n = TEMP_FAILURE_RETRY(
+                    pwrite64(fd_, buf, buf_size, offset_ + total_bytes_written_));
+            if (n <= 0) {
+                // |errno| tells why.
+                return false;
+            }
+            buf += n;
+            buf_size -= n;
+            total_bytes_written_ += n;
+        }
+        return true;
+    }
+
+private:
+    const int fd_;
+    const off64_t offset_;
+    const size_t declared_length_;
+    size_t total_bytes_written_;
+};
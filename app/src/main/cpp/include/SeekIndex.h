@@ -0,0 +1,113 @@
+//
+// Created by season on 2021/7/15.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "InflateContext.h"
+#include "MappedZipFile.h"
+#include "ZipEntry.h"
+
+namespace hms {
+    // Header of a saved SeekIndex, followed by its checkpoints and then their
+    // windows. Stored in native byte order, like the index cache.
+    struct SeekIndexHeader {
+        static const uint32_t kMagic = 0x4b45535a;  // "ZSEK"
+        static const uint32_t kVersion = 2;
+
+        uint32_t magic;
+        uint32_t version;
+        // Identity of the entry the index was built from.
+        uint64_t entry_offset;
+        uint32_t compressed_length;
+        uint32_t uncompressed_length;
+        uint32_t crc32;
+        uint32_t spacing;
+        uint32_t num_checkpoints;
+        // CRC-32 of the checkpoints and windows that follow.
+        uint32_t data_crc32;
+    } __attribute__((packed));
+
+    /*
+     * Points at which the deflate stream of one entry can be resumed without
+     * inflating what comes before, as in zlib's zran example. A checkpoint
+     * sits at a deflate block boundary and records the compressed and
+     * uncompressed offsets there, the bits of the last compressed byte that
+     * belong to the next block, and the 32 KB of output before it, which
+     * later matches may refer to. ZipFile::BuildSeekIndex records one every
+     * |spacing| uncompressed bytes or so; ZipFile::ReadAt then only inflates
+     * from the nearest checkpoint before the requested offset.
+     *
+     * An index costs 32 KB per checkpoint and can be saved next to the
+     * archive and loaded again in a later process.
+     */
+    class SeekIndex {
+    public:
+        static const size_t kWindowSize = 32768;
+
+        // Checkpoint spacing that costs 3% of the entry size in windows.
+        static const uint32_t kDefaultSpacing = 1024 * 1024;
+
+        SeekIndex() : header_() {}
+
+        size_t GetNumCheckpoints() const { return checkpoints_.size(); }
+
+        // Whether the index was built from |entry|.
+        bool Matches(const ZipEntry &entry) const;
+
+        /*
+         * Atomically replace the file at |path| with the index.
+         *
+         * Returns 0 on success and kIoError on failure.
+         */
+        int32_t WriteToFile(const char *path) const;
+
+        /*
+         * Replace the index with the one saved at |path|.
+         *
+         * Returns 0 on success, kIoError if the file cannot be read and
+         * kInconsistentInformation if it is not a valid index or fails its
+         * checksum.
+         */
+        int32_t ReadFromFile(const char *path);
+
+    private:
+        friend class ZipFile;
+
+        struct Checkpoint {
+            // Uncompressed and compressed offsets of the block boundary.
+            uint64_t out;
+            uint64_t in;
+            // Bits of the byte before |in| that are still to be inflated.
+            uint32_t bits;
+            uint32_t reserved;
+        };
+
+        // Inflate all of |entry|, whose local file header has been checked,
+        // recording checkpoints.
+        int32_t Build(const MappedZipFile *zip, const ZipEntry &entry, InflateContext *context,
+                      uint32_t spacing, bool check_crc);
+
+        // Inflate |len| bytes of |entry| at |offset| to |out|.
+        int64_t Read(const MappedZipFile *zip, const ZipEntry &entry, InflateContext *context,
+                     uint64_t offset, uint8_t *out, size_t len) const;
+
+        void Clear();
+
+        // Mark the index as built from |entry|.
+        void SetEntry(const ZipEntry &entry, uint32_t spacing);
+
+        // Record a checkpoint whose preceding output ends at |pos| in the
+        // ring buffer |ring| of InflateContext::kBufferSize bytes.
+        void AddCheckpoint(uint32_t bits, uint64_t in, uint64_t out,
+                           const uint8_t *ring, size_t pos);
+
+        SeekIndexHeader header_;
+        std::vector<Checkpoint> checkpoints_;
+        std::vector<uint8_t> windows_;
+    };
+}
@@ -0,0 +1,89 @@
+//
+// Created by season on 2021/7/14.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+
+#include "Macros.h"
+
+namespace hms {
+    /*
+     * Bounded queue between exactly one producer thread and one consumer
+     * thread. TryPush and TryPop never lock or wait: each side only writes
+     * its own index and publishes it with a release store. Push and Pop spin
+     * and then yield until they succeed or |cancelled| is set.
+     */
+    template<typename T, size_t kCapacity>
+    class SpscQueue {
+        static_assert(kCapacity != 0 && (kCapacity & (kCapacity - 1)) == 0,
+                      "SpscQueue capacity must be a power of two");
+
+    public:
+        SpscQueue() : head_(0), tail_(0) {}
+
+        bool TryPush(const T &value) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+                return false;
+            }
+            slots_[tail & (kCapacity - 1)] = value;
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool TryPop(T *value) {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (tail_.load(std::memory_order_acquire) == head) {
+                return false;
+            }
+            *value = slots_[head & (kCapacity - 1)];
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Returns "false" if |cancelled| was set before |value| fit.
+        bool Push(const T &value, const std::atomic<bool> &cancelled) {
+            for (unsigned spins = 0; !TryPush(value); ++spins) {
+                if (!Wait(spins, cancelled)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Returns "false" if |cancelled| was set while the queue was empty;
+        // values queued before are still returned.
+        bool Pop(T *value, const std::atomic<bool> &cancelled) {
+            for (unsigned spins = 0; !TryPop(value); ++spins) {
+                if (!Wait(spins, cancelled)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        static const unsigned kSpins = 128;
+
+        static bool Wait(unsigned spins, const std::atomic<bool> &cancelled) {
+            if (cancelled.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            if (spins >= kSpins) {
+                std::this_thread::yield();
+            }
+            return true;
+        }
+
+        // On separate cache lines, so the two sides do not false share.
+        alignas(64) std::atomic<size_t> head_;
+        alignas(64) std::atomic<size_t> tail_;
+        alignas(64) T slots_[kCapacity];
+
+        DISALLOW_COPY_AND_ASSIGN(SpscQueue);
+    };
+}
@@ -0,0 +1,145 @@
+//
+// Created by season on 2021/7/13.
+//
+
+#pragma once
+#include "FileWriter.h"
+#include "IoUring.h"
+
+class UringFileWriter : public Writer {
+public:
+    // Creates a writer for |fd|, sized for |entry| like a FileWriter, whose
+    // writes go through |ring|. Append copies the data into one of the
+    // ring's write buffers and queues the write instead of making it, so
+    // several writes reach the kernel in one system call (together with the
+    // read-ahead of a ChunkReader on the same ring) and complete while the
+    // caller produces more data. Flush waits for them.
+    //
+    // Returns |nullptr| if an error occurred.
+    static std::unique_ptr<UringFileWriter> Create(int fd, const ZipEntry *entry,
+                                                   hms::IoUring *ring) {
+        off64_t current_offset;
+        bool reserved;
+        if (!FileWriter::Prepare(fd, entry, &current_offset, &reserved)) {
+            return std::unique_ptr<UringFileWriter>(nullptr);
+        }
+
+        // Writes carry their own offsets; leave the file offset after the
+        // entry, as writing it would have.
+        const size_t declared_length = entry->uncompressed_length;
+        if (lseek64(fd, current_offset + declared_length, SEEK_SET) == -1) {
+            HLOGW("Zip: unable to seek past entry on fd %d: %s", fd, strerror(errno));
+            return std::unique_ptr<UringFileWriter>(nullptr);
+        }
+
+        return std::unique_ptr<UringFileWriter>(
+                new UringFileWriter(fd, ring, current_offset, declared_length));
+    }
+
+    virtual ~UringFileWriter() {
+        // The ring's buffers must not be reused while writes are in flight.
+        Flush();
+    }
+
+    virtual bool Append(const uint8_t *buf, size_t buf_size) override {
+        if (total_bytes_written_ + buf_size > declared_length_) {
+            HLOGW("Zip: Unexpected size "
+            ZD
+            " (declared) vs "
+            ZD
+            " (actual)", declared_length_,
+                    total_bytes_written_ + buf_size);
+            return false;
+        }
+
+        while (buf_size > 0) {
+            Slot &slot = slots_[next_slot_];
+            if (slot.token != 0 && !Complete(&slot)) {
+                return false;
+            }
+
+            const size_t chunk = buf_size > hms::IoUring::kBufferSize
+                                 ? hms::IoUring::kBufferSize : buf_size;
+            uint8_t *const buffer = ring_->GetWriteBuffer(next_slot_);
+            memcpy(buffer, buf, chunk);
+            slot.token = ring_->PrepareWrite(fd_, buffer, chunk, offset_);
+            if (slot.token == 0) {
+                return false;
+            }
+            slot.buffer = buffer;
+            slot.length = chunk;
+            slot.offset = offset_;
+
+            offset_ += chunk;
+            total_bytes_written_ += chunk;
+            buf += chunk;
+            buf_size -= chunk;
+            next_slot_ = (next_slot_ + 1) % hms::IoUring::kNumWriteBuffers;
+        }
+        return true;
+    }
+
+    virtual bool Flush() override {
+        bool result = true;
+        for (unsigned i = 0; i < hms::IoUring::kNumWriteBuffers; ++i) {
+            // Oldest first.
+            Slot &slot = slots_[(next_slot_ + i) % hms::IoUring::kNumWriteBuffers];
+            if (slot.token != 0 && !Complete(&slot)) {
+                result = false;
+            }
+        }
+        return result;
+    }
+
+private:
+    struct Slot {
+        uint64_t token;
+        const uint8_t *buffer;
+        size_t length;
+        off64_t offset;
+    };
+
+    UringFileWriter(const int fd, hms::IoUring *ring, const off64_t offset,
+                    const size_t declared_length)
+            : Writer(), fd_(fd), ring_(ring), offset_(offset), declared_length_(declared_length),
+              total_bytes_written_(0), next_slot_(0) {
+        memset(slots_, 0, sizeof(slots_));
+    }
+
+    // Wait for the write of |slot|, finishing a short one with pwrite.
+    bool Complete(Slot *slot) {
+        int32_t result;
+        const bool waited = ring_->Wait(slot->token, &result);
+        slot->token = 0;
+        if (!waited) {
+            return false;
+        }
+        if (result < 0) {
+            HLOGW("Zip: unable to write " ZD " bytes to file; %s", slot->length,
+                  strerror(-result));
+            return false;
+        }
+
+        size_t done = static_cast<size_t>(result);
+        while (done < slot->length) {
+            const ssize_t n = TEMP_FAILURE_RETRY(pwrite64(fd_, slot->buffer + done,
+                                                          slot->length - done,
+                                                          slot->offset + done));
+            if (n <= 0) {
+                HLOGW("Zip: unable to write " ZD " bytes to file; %s", slot->length - done,
+                      strerror(errno));
+                return false;
+            }
+            done += n;
+        }
+        return true;
+    }
+
+    const int fd_;
+    hms::IoUring *const ring_;
+    off64_t offset_;
+    const size_t declared_length_;
+    size_t total_bytes_written_;
+    Slot slots_[hms::IoUring::kNumWriteBuffers];
+    unsigned next_slot_;
+};
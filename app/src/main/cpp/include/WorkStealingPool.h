@@ -0,0 +1,59 @@
+//
+// Created by season on 2021/7/8.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Macros.h"
+
+namespace hms {
+    /*
+     * Runs a batch of independent tasks on a fixed number of threads.
+     *
+     * Tasks are identified by their position in the batch and are dealt round
+     * robin to one queue per thread, so when the batch is ordered by cost
+     * every queue is too and the most expensive tasks start first. A thread
+     * whose queue runs dry takes the next task from the front of another
+     * thread's queue, which keeps all threads busy until the batch is done
+     * without a shared queue every thread contends on.
+     */
+    class WorkStealingPool {
+    public:
+        typedef std::function<void(size_t task)> Task;
+
+        // |num_threads| includes the thread calling Run. 0 uses one thread
+        // per online CPU.
+        explicit WorkStealingPool(size_t num_threads);
+
+        size_t GetNumThreads() const { return num_threads_; }
+
+        /*
+         * Call |task| once for each of 0 .. |num_tasks| - 1 and return when
+         * every call has returned. |task| is called concurrently and must not
+         * throw.
+         */
+        void Run(size_t num_tasks, const Task &task);
+
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<size_t> tasks;
+        };
+
+        bool Pop(size_t queue, size_t *task);
+
+        void Work(size_t self, const Task &task);
+
+        size_t num_threads_;
+        std::unique_ptr<Queue[]> queues_;
+
+        DISALLOW_COPY_AND_ASSIGN(WorkStealingPool);
+    };
+}
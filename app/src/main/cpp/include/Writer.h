@@ -6,7 +6,25 @@
 
 class Writer {
 public:
-    virtual bool Append(uint8_t *buf, size_t buf_size) = 0;
+    virtual bool Append(const uint8_t *buf, size_t buf_size) = 0;
+
+    // Writers whose whole destination is addressable return it here, so
+    // that an entry can be produced in place instead of being Appended. The
+    // buffer holds exactly the declared length of the entry. Writers that
+    // only support Append return |nullptr|.
+    virtual uint8_t *GetDirectBuffer() { return nullptr; }
+
+    // Copy up to |length| bytes at |offset| in |in_fd| to the destination
+    // inside the kernel, without passing them through user space. Returns
+    // the number of bytes copied, which is short (possibly 0) when the
+    // kernel cannot copy the rest and the caller has to Append it, or -1 on
+    // an I/O error. Writers without a file descriptor copy nothing.
+    virtual ssize_t CopyFileRange(int in_fd, off64_t offset, size_t length) { return 0; }
+
+    // Wait until everything Appended has reached the destination, for
+    // writers that complete writes asynchronously. Returns "false" if any
+    // of them failed.
+    virtual bool Flush() { return true; }
 
     virtual ~Writer() {}
 
@@ -37,6 +37,10 @@ struct ZipEntry {
     // footer.
     uint32_t uncompressed_length;
 
-    // The offset to the start of data for this ZipEntry.
+    // The offset to the start of data for this ZipEntry, or 0 if its local
+    // file header has not been validated yet.
     off64_t offset;
+
+    // Position of this entry in its archive's entry index.
+    uint32_t index;
 };
\ No newline at end of file
@@ -8,13 +8,29 @@
 #include <ZipString.h>
 #include <sys/types.h>
 #include <cstdlib>
+#include <atomic>
 #include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <zconf.h>
+#include <base/utf8.h>
 #include "Writer.h"
 #include "CentralDirectory.h"
 #include "FileMap.h"
 #include "MappedZipFile.h"
 #include "IterationHandle.h"
+#include "EntryIndex.h"
+#include "DirectoryTree.h"
+#include "IndexCache.h"
+#include "ZipOptions.h"
+#include "ExtractReport.h"
+#include "EntryReader.h"
+#include "EntryView.h"
+#include "SeekIndex.h"
+#include "InflateContext.h"
+#include "Decompressor.h"
 #include <ZipFileCommon.h>
 
 namespace hms {
@@ -37,6 +53,9 @@ namespace hms {
             "Invalid entry name",
             "I/O error",
             "File mapping failed",
+            "Not a directory",
+            "Entry is compressed",
+            "Cancelled",
     };
     enum ErrorCodes : int32_t {
         kIterationEnd = -1,
@@ -81,9 +100,28 @@ namespace hms {
         // We were not able to mmap the central directory or entry contents.
         kMmapFailed = -12,
 
-        kLastErrorCode = kMmapFailed,
+        // A directory operation was given the path of a file.
+        kNotADirectory = -13,
+
+        // A zero-copy view was requested for an entry that is not stored.
+        kEntryCompressed = -14,
+
+        // A batch operation stopped before it got to the entry.
+        kCancelled = -15,
+
+        kLastErrorCode = kCancelled,
     };
 
+    // Selects the entries of a batch operation. An empty filter selects every
+    // entry.
+    typedef std::function<bool(const ZipString &name)> EntryFilter;
+
+    /*
+     * A Zip archive. Once OpenArchive has returned, every other method may be
+     * called concurrently from any number of threads: reads are positional,
+     * iteration state lives in caller-owned cookies and the lazily built
+     * indexes are initialized exactly once.
+     */
     class ZipFile {
     public:
         /*
@@ -95,82 +133,225 @@ namespace hms {
          */
         int32_t OpenArchive();
 
+        /*
+         * As above, but with the behaviour tuned by |options|.
+         */
+        int32_t OpenArchive(const OpenOptions &options);
+
         /*
          * Start iterating over all entries of a zip file. The order of iteration
          * is not guaranteed to be the same as the order of elements
-         * in the central directory but is stable for a given zip file. |cookie| will
+         * in the central directory but is stable for a given zip file. When
+         * |optional_prefix| is given, entries are returned in lexicographic order
+         * by walking a contiguous range of the sorted name index, so only the
+         * matching entries are ever visited. |cookie| will
          * contain the value of an opaque cookie which can be used to make one or more
-         * calls to Next. All calls to StartIteration must be matched by a call to
-         * EndIteration to free any allocated memory.
+         * calls to Next. The cookie is owned by the caller, so several iterations
+         * may run at the same time, on the same thread or on different ones.
          *
          * This method also accepts optional prefix and suffix to restrict iteration to
          * entry names that start with |optional_prefix| or end with |optional_suffix|.
          *
+         * If |metadata_only| is true, Next only returns what the central directory
+         * says about each entry and never reads its local file header, so listing
+         * an archive does no I/O at all. The |offset| of such entries is 0; the
+         * local file header is validated, and the data offset computed and cached,
+         * when the entry is first extracted.
+         *
          * Returns 0 on success and negative values on failure.
          */
-        int32_t StartIteration(const ZipString *optional_prefix, const ZipString *optional_suffix);
+        int32_t StartIteration(std::unique_ptr<IterationHandle> *cookie,
+                               const ZipString *optional_prefix, const ZipString *optional_suffix,
+                               bool metadata_only = false);
 
         /*
-         * Advance to the next element in the zipfile in iteration order.
+         * Advance |cookie| to the next element in the zipfile in iteration order.
          *
          * Returns 0 on success, -1 if there are no more elements in this
          * archive and lower negative values on failure.
          */
-        int32_t Next(ZipEntry *data, ZipString *name);
+        int32_t Next(IterationHandle *cookie, ZipEntry *data, ZipString *name);
 
+        /*
+         * Find an entry in the Zip archive, by name. |data| must be non-null.
+         *
+         * The lookup is a single probe of the hash table built when the archive
+         * was opened, followed by one read of the entry's local file header.
+         *
+         * Returns 0 if an entry is found, and populates |data| with information
+         * about this entry. Returns negative values otherwise.
+         */
+        int32_t FindEntry(const ZipString &name, ZipEntry *data);
+
+        /*
+         * Find the entry at position |index| of the archive's entry index, as
+         * reported by ZipDirEntry::entry_index, without a hash lookup.
+         *
+         * Returns 0 if an entry is found, and populates |data| with information
+         * about this entry. Returns kEntryNotFound if |index| is out of range
+         * and other negative values on failure.
+         */
+        int32_t FindEntryByIndex(uint32_t index, ZipEntry *data);
+
+        /*
+         * List the direct children of the directory |path| ("" for the root) in
+         * name order. Directories without an entry of their own are synthesized
+         * from the names beneath them. The directory tree is built on first use.
+         *
+         * Returns 0 on success, kEntryNotFound if there is no such path and
+         * kNotADirectory if |path| names a file.
+         */
+        int32_t ListDirectory(const ZipString &path, std::vector<ZipDirEntry> *children);
+
+        /*
+         * Describe the file or directory at |path| in |out|, including the
+         * entry to pass to FindEntryByIndex for everything but synthetic
+         * directories.
+         *
+         * Returns 0 on success and kEntryNotFound if there is no such path.
+         */
+        int32_t Stat(const ZipString &path, ZipDirEntry *out);
 
         /*
          * Uncompress and write an entry to an open file identified by |fd|.
          * |entry->uncompressed_length| bytes will be written to the file at
          * its current offset, and the file will be truncated at the end of
          * the uncompressed data (no truncation if |fd| references a block
-         * device).
+         * device). When |fd| is open O_RDWR, large deflated entries are
+         * inflated directly into a shared mapping of the destination; stored
+         * entries are copied by the kernel when OpenOptions::verify_crc is off.
+         * Deflated entries are inflated by |decompressor|, or by the engine
+         * of the archive (OpenOptions::decompressor) for kDecompressorDefault.
          *
          * Returns 0 on success and negative values on failure.
          */
-        int32_t ExtractEntryToFile(ZipEntry *entry, int fd);
+        int32_t ExtractEntryToFile(ZipEntry *entry, int fd,
+                                   DecompressorType decompressor = kDecompressorDefault);
 
-        const char *ErrorCodeString(int32_t error_code);
+        /*
+         * Uncompress an entry into |out|, which ends up holding exactly
+         * |entry->uncompressed_length| bytes, allocated once (see
+         * MemoryWriter). |out| is cleared on failure.
+         *
+         * Returns 0 on success and negative values on failure.
+         */
+        int32_t ExtractEntryToMemory(ZipEntry *entry, std::vector<uint8_t> *out,
+                                     DecompressorType decompressor = kDecompressorDefault);
 
-    private:
-        bool IsValidEntryName(const uint8_t *entry_name, const size_t length) {
-            for (size_t i = 0; i < length; ++i) {
-                const uint8_t byte = entry_name[i];
-                if (byte == 0) {
-                    return false;
-                } else if ((byte & 0x80) == 0) {
-                    // Single byte sequence.
-                    continue;
-                } else if ((byte & 0xc0) == 0x80 || (byte & 0xfe) == 0xfe) {
-                    // Invalid sequence.
-                    return false;
-                } else {
-                    // 2-5 byte sequences.
-                    for (uint8_t first = byte << 1; first & 0x80; first <<= 1) {
-                        ++i;
-
-                        // Missing continuation byte..
-                        if (i == length) {
-                            return false;
-                        }
-
-                        // Invalid continuation byte.
-                        const uint8_t continuation_byte = entry_name[i];
-                        if ((continuation_byte & 0xc0) != 0x80) {
-                            return false;
-                        }
-                    }
-                }
-            }
+        /*
+         * Uncompress an entry into the |size| bytes at |buf|, without
+         * allocating.
+         *
+         * Returns 0 on success, kIoError if the entry does not fit and other
+         * negative values on failure.
+         */
+        int32_t ExtractEntryToMemory(ZipEntry *entry, uint8_t *buf, size_t size,
+                                     DecompressorType decompressor = kDecompressorDefault);
 
-            return true;
-        }
+        /*
+         * Uncompress an entry and hand it to |writer|, for destinations the
+         * other Extract* calls do not cover, such as a slice of an existing
+         * file (OffsetFileWriter) or a consumer of the data (CallbackWriter).
+         * The data is checked against the entry's CRC-32 if
+         * OpenOptions::verify_crc is set.
+         *
+         * Returns 0 on success and negative values on failure.
+         */
+        int32_t ExtractEntryToWriter(ZipEntry *entry, Writer *writer,
+                                     DecompressorType decompressor = kDecompressorDefault);
+
+        /*
+         * Point |view| at the bytes of the stored entry |entry|, inside a
+         * read-only mapping of the archive. The archive is mapped once, on the
+         * first call (or reused from OpenOptions::map_archive), so later views
+         * cost no system call and no copy. The data is not checked against the
+         * entry's CRC. The archive must not be truncated while views exist.
+         *
+         * Returns 0 on success, kEntryCompressed if |entry| is not stored and
+         * other negative values on failure.
+         */
+        int32_t OpenEntryView(ZipEntry *entry, EntryView *view);
+
+        /*
+         * Open |reader| on |entry|, to pull its uncompressed bytes in pieces
+         * of the caller's choosing (see EntryReader). Nothing is read from
+         * the entry's data until the first Read or Skip. A data descriptor is
+         * checked up front; the CRC-32 when the last byte has been consumed,
+         * if OpenOptions::verify_crc is set.
+         *
+         * Returns 0 on success and negative values on failure.
+         */
+        int32_t OpenEntryReader(ZipEntry *entry, EntryReader *reader);
 
-        uint32_t RoundUpPower2(uint32_t val);
+        /*
+         * Inflate |entry| once, checking it as an extraction would, and fill
+         * |index| with a checkpoint about every |spacing| uncompressed bytes
+         * (see SeekIndex). A stored entry gets an index without checkpoints,
+         * since it can be read at any offset as it is.
+         *
+         * Returns 0 on success and negative values on failure.
+         */
+        int32_t BuildSeekIndex(ZipEntry *entry, SeekIndex *index,
+                               uint32_t spacing = SeekIndex::kDefaultSpacing);
 
-        uint32_t ComputeHash(const ZipString &name);
+        /*
+         * Copy up to |len| bytes of |entry|, from the uncompressed |offset|
+         * on, to |buf|. A deflated entry is inflated from the last checkpoint
+         * of |index| at or before |offset|, which must have been built from
+         * or saved for |entry|. The data is not checked against the entry's
+         * CRC-32.
+         *
+         * Returns the number of bytes copied, 0 at or past the end of the
+         * entry, kInconsistentInformation if |index| belongs to another entry
+         * and other negative values on failure.
+         */
+        int64_t ReadAt(ZipEntry *entry, const SeekIndex &index, uint64_t offset,
+                       void *buf, size_t len);
 
-        int32_t AddToHash(const ZipString &name);
+        /*
+         * Extract every entry accepted by |filter| below |target_dir|, keeping
+         * the directory structure of the archive. Directories are created up
+         * front, then files are extracted by |options.num_threads| threads,
+         * largest compressed size first so that a big entry does not start
+         * last and hold up the whole batch. Names that are absolute or
+         * contain a ".." component are refused with kInvalidEntryName, and so
+         * are entries whose destination, or a directory on the way to it, is
+         * a symbolic link: nothing is written outside |target_dir|.
+         *
+         * The outcome of each entry is recorded in |report|; a failed entry
+         * does not stop the others. With ExtractOptions::skip_unchanged,
+         * files that already hold their entry are not rewritten.
+         *
+         * Returns 0 if every entry was extracted or skipped, or the error of the first
+         * failed entry in |report| otherwise.
+         */
+        int32_t ExtractAll(const EntryFilter &filter, const char *target_dir,
+                           const ExtractOptions &options, ExtractReport *report);
+
+        /*
+         * Check that every entry accepted by |filter| is intact, without
+         * writing it anywhere: its local file header must agree with the
+         * central directory, its data must decompress to the declared length
+         * and CRC-32 (whatever OpenOptions::verify_crc says), and its data
+         * descriptor, if any, must agree too. Entries are checked by
+         * |options.num_threads| threads, largest compressed size first.
+         * Opening the archive with OpenOptions::map_archive saves a copy of
+         * the compressed data.
+         *
+         * The outcome of each entry is recorded in |report|.
+         *
+         * Returns 0 if every entry is intact, or the error of the first
+         * failed entry in |report| otherwise.
+         */
+        int32_t VerifyAll(const EntryFilter &filter, const VerifyOptions &options,
+                          VerifyReport *report);
+
+        const char *ErrorCodeString(int32_t error_code);
+
+    private:
+        bool IsValidEntryName(const uint8_t *entry_name, const size_t length) {
+            return android::base::IsValidUtf8(entry_name, length);
+        }
 
         int32_t MapCentralDirectory0(off64_t file_length, off64_t read_amount,
                                      uint8_t *scan_buffer);
@@ -181,22 +362,76 @@ namespace hms {
 
         int32_t OpenArchiveInternal();
 
+        void ResetResolvedOffsets();
+
+        int32_t OpenArchiveInternal(const OpenOptions &options);
+
+        void BuildSortedIndex();
+
+        void BuildDirectoryTree();
+
+        void MapArchiveForViews();
+
+        uint32_t ComputeCentralDirectoryCrc();
+
+        int32_t LoadIndexCache(const char *path, const struct stat &sb);
+
+        void WriteIndexCache(const char *path, const struct stat &sb);
+
         int32_t ValidateDataDescriptor(ZipEntry *entry);
 
-        int32_t FindEntry(const int ent, ZipEntry *data);
+        void FillEntryFromIndex(const uint32_t ent, ZipEntry *data);
 
-        int32_t ExtractToWriter(ZipEntry *entry, Writer *writer);
+        int32_t ValidateLocalFileHeader(ZipEntry *data);
 
-        int32_t
-        CopyEntryToWriter(const ZipEntry *entry, Writer *writer,
-                          uint64_t *crc_out);
+        int32_t FindEntry(const int ent, ZipEntry *data);
 
-        int32_t InflateEntryToWriter(const ZipEntry *entry,
-                                     Writer *writer, uint64_t *crc_out);
+        // Extract |entry| to |writer|, checking it against its CRC-32 if
+        // |check_crc| is set.
+        int32_t ExtractToWriter(ZipEntry *entry, Writer *writer,
+                                DecompressorType decompressor, bool check_crc);
+
+        // Extract entry |ent| to the file |file_name| in the directory open
+        // as |dir_fd|, which must not be a symbolic link.
+        int32_t ExtractEntryAt(uint32_t ent, int dir_fd, const std::string &file_name,
+                               const ExtractOptions &options, uint64_t *bytes_written);
+
+        // Whether the file |file_name| in |dir_fd| already holds entry |ent|,
+        // judging by its stamp or else its contents. Stamps it in the latter
+        // case.
+        bool DestinationMatches(uint32_t ent, int dir_fd, const std::string &file_name);
+
+        // Write |entry| to |fd| with the writer that suits it and |options|.
+        int32_t ExtractEntryToFd(ZipEntry *entry, int fd, const ExtractOptions &options);
+
+        int32_t VerifyEntry(uint32_t ent, DecompressorType decompressor);
+
+        int32_t CopyEntryToWriter(const ZipEntry *entry, Writer *writer,
+                                  bool check_crc, uint64_t *crc_out);
+
+        int32_t InflateEntryToWriter(const ZipEntry *entry, Writer *writer,
+                                     DecompressorType decompressor, bool check_crc,
+                                     uint64_t *crc_out);
+
+        // Inflate the whole entry in one |decompressor| call. Used for entries
+        // whose compressed and uncompressed data both fit an InflateContext
+        // buffer, and for entries with kDecompressorDeflate whose staging
+        // fits kMaxStagedLength. |heap_input| and |heap_output| hold the whole
+        // compressed and uncompressed data where the context buffers are too
+        // small and neither the mapping nor the writer can be used.
+        int32_t DecompressEntryToWriter(const ZipEntry *entry, Writer *writer,
+                                        Decompressor *decompressor, InflateContext *context,
+                                        uint8_t *heap_input, uint8_t *heap_output,
+                                        bool check_crc, uint64_t *crc_out);
+
+        // Inflate |entry| with zlib, reading the archive and Appending to
+        // |writer| on threads of their own. See OpenOptions::pipeline_threshold.
+        int32_t InflateEntryPipelined(const ZipEntry *entry, Writer *writer,
+                                      InflateContext *context, bool check_crc,
+                                      uint64_t *crc_out);
 
     public:
         mutable std::unique_ptr<hms::MappedZipFile> mapped_zip;
-        std::unique_ptr<IterationHandle> mCookie;
         const bool close_file;
 
         // mapped central directory area
@@ -211,8 +446,45 @@ namespace hms {
         // fixed-size hash table. We define a load factor of 0.75 and over
         // allocate so the maximum number entries can never be higher than
         // ((4 * UINT16_MAX) / 3 + 1) which can safely fit into a uint32_t.
-        uint32_t hash_table_size;
-        ZipString *hash_table;
+        EntryIndex entry_index;
+
+        // Backing store of |entry_index| when it was loaded from a cache.
+        std::unique_ptr<IndexCache> index_cache;
+
+        // Data offset of each entry once its local file header has been
+        // validated, with kResolvedDataDescriptor set if the header declares a
+        // data descriptor. 0 until then, since data never starts at offset 0.
+        std::unique_ptr<std::atomic<uint64_t>[]> resolved_offsets;
+
+        // Entry indices ordered by name, built on first use by BuildSortedIndex.
+        std::vector<uint16_t> sorted_entries;
+        std::once_flag sorted_entries_once;
+
+        // Directory view of the entry names, built on first use.
+        DirectoryTree directory_tree;
+        std::once_flag directory_tree_once;
+
+        // Mapping of the whole archive shared with EntryViews, made on first
+        // use. Stays null for archives opened from memory.
+        std::shared_ptr<FileMap> view_map;
+        std::once_flag view_map_once;
+
+        // Check extracted data against the CRC-32 of its entry. Set from
+        // OpenOptions::verify_crc.
+        bool verify_crc;
+
+        // zlib streams and I/O buffers recycled across extractions.
+        InflateContextPool inflate_contexts;
+
+        // Engine for deflated entries when a call does not pick one. Set from
+        // OpenOptions::decompressor.
+        DecompressorType decompressor;
+
+        // Set from OpenOptions::io_uring.
+        bool use_io_uring;
+
+        // Set from OpenOptions::pipeline_threshold.
+        uint32_t pipeline_threshold;
 
         ZipFile(const char *archive_name)
                 : mArchiveName(archive_name),
@@ -221,16 +493,16 @@ namespace hms {
                   central_directory(),
                   directory_map(new hms::FileMap()),
                   num_entries(0),
-                  hash_table_size(0),
-                  hash_table(nullptr) {
+                  verify_crc(true),
+                  decompressor(kDecompressorDefault),
+                  use_io_uring(false),
+                  pipeline_threshold(0) {
         }
 
         virtual ~ZipFile() {
-            if (close_file && mapped_zip->GetFileDescriptor() >= 0) {
+            if (close_file && mapped_zip != nullptr && mapped_zip->HasFd()) {
                 close(mapped_zip->GetFileDescriptor());
             }
-
-            free(hash_table);
         }
 
         bool InitializeCentralDirectory(off64_t cd_start_offset,
@@ -238,7 +510,11 @@ namespace hms {
 
     private:
         static const uint32_t kMaxEOCDSearch = kMaxCommentLen + sizeof(EocdRecord);
-        static const bool kCrcChecksEnabled = false;
+        // Entries at least this large are written through a MappedFileWriter
+        // when the destination allows it; below it mmap costs more than write.
+        static const uint32_t kMappedWriterThreshold = 256 * 1024;
+        static const uint64_t kResolvedOffsetMask = 0xffffffffULL;
+        static const uint64_t kResolvedDataDescriptor = 1ULL << 32;
         const char *mArchiveName;
     };
 }
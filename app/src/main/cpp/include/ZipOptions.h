@@ -0,0 +1,135 @@
+//
+// Created by season on 2021/7/3.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Decompressor.h"
+
+namespace hms {
+    struct OpenOptions {
+        // Path of an optional sidecar file caching the parsed central directory
+        // index. When the cache matches the archive (same inode, size, mtime and
+        // central directory checksum) the archive is opened without scanning for
+        // the EOCD or rebuilding the hash table; otherwise the archive is parsed
+        // as usual and the cache is (re)written. |nullptr| disables the cache.
+        const char *index_cache_path;
+
+        // Build the sorted name index used by prefix iteration while opening
+        // the archive, instead of on the first prefix query.
+        bool build_sorted_index;
+
+        // Map the whole archive once instead of reading it with pread. Entry
+        // data is then inflated or copied straight out of the page cache,
+        // without read syscalls or a bounce buffer. The archive must not be
+        // truncated while it is open. Falls back to reads if mapping fails.
+        bool map_archive;
+
+        // Check every extracted entry against its CRC-32 and fail with
+        // kInconsistentInformation on a mismatch. The CRC is computed with
+        // the CPU's CRC instructions where available (see Crc32). Turning
+        // this off lets stored entries be copied by the kernel.
+        bool verify_crc;
+
+        // Engine inflating the archive's deflated entries unless a call picks
+        // another one. kDecompressorDefault is zlib.
+        DecompressorType decompressor;
+
+        // Use io_uring where the kernel allows it: archive reads of streamed
+        // entries keep the next chunk in flight while the current one is
+        // processed, and the writes of large deflated entries are queued and
+        // submitted in batches. Ignored, with the usual system calls used
+        // instead, when io_uring is unavailable; Android's app sandbox
+        // blocks it.
+        bool io_uring;
+
+        // Deflated entries inflating to at least this many bytes are
+        // extracted by three threads: one reading the archive, one inflating
+        // and checking the CRC, one writing, handing recycled buffers to each
+        // other through lock-free queues. A large entry then takes about as
+        // long as the slower of its I/O and its inflation rather than their
+        // sum. Only zlib streaming is pipelined, and a stage is dropped when
+        // the archive is mapped or the writer exposes its destination. 0, the
+        // default, never pipelines.
+        uint32_t pipeline_threshold;
+
+        OpenOptions()
+                : index_cache_path(nullptr),
+                  build_sorted_index(false),
+                  map_archive(false),
+                  verify_crc(true),
+                  decompressor(kDecompressorDefault),
+                  io_uring(false),
+                  pipeline_threshold(0) {}
+    };
+
+    struct ExtractOptions {
+        // Number of threads extracting entries, the calling thread included.
+        // 0 uses one thread per online CPU.
+        uint32_t num_threads;
+
+        // Engine inflating deflated entries; kDecompressorDefault keeps the
+        // one of the archive.
+        DecompressorType decompressor;
+
+        // Ask for readahead of each entry's data before it is extracted
+        // (POSIX_FADV_WILLNEED) and drop it from the page cache afterwards
+        // (POSIX_FADV_DONTNEED), so that extracting a large
+        // archive does not evict the rest of the app's working set. Leave
+        // off if the archive will be read again soon.
+        bool drop_source_cache;
+
+        // Write extracted files back as they are written (sync_file_range)
+        // and drop them from the page cache, 8 MB at a time, instead of
+        // leaving the dirty pages to the kernel. Files are then written with
+        // write() rather than through a shared mapping.
+        bool drop_destination_cache;
+
+        // Write files of at least kDirectIoThreshold bytes with O_DIRECT
+        // from aligned buffers, bypassing the page cache altogether. Falls
+        // back to ordinary writes where the file system does not support it.
+        bool direct_io;
+
+        static const uint32_t kDirectIoThreshold = 1024 * 1024;
+
+        // Leave alone files that already hold their entry, as after an
+        // earlier extraction to the same directory. A regular file of the
+        // entry's size is skipped if its stamp, an extended attribute
+        // recording the entry's CRC-32 and the file's inode and mtime when
+        // it was written, still matches; failing that, if the CRC-32 of its
+        // contents matches the central directory, after which it is stamped.
+        // Files extracted with this set are stamped too, so an unchanged
+        // file normally costs a stat, an open and a getxattr. Where the file
+        // system has no user extended attributes every file is read instead.
+        bool skip_unchanged;
+
+        ExtractOptions()
+                : num_threads(0),
+                  decompressor(kDecompressorDefault),
+                  drop_source_cache(false),
+                  drop_destination_cache(false),
+                  direct_io(false),
+                  skip_unchanged(false) {}
+    };
+
+    struct VerifyOptions {
+        // Number of threads checking entries, the calling thread included.
+        // 0 uses one thread per online CPU.
+        uint32_t num_threads;
+
+        // Stop at the first entry that fails. Entries not checked yet are
+        // reported with kCancelled.
+        bool stop_on_failure;
+
+        // Engine inflating deflated entries; kDecompressorDefault keeps the
+        // one of the archive.
+        DecompressorType decompressor;
+
+        VerifyOptions()
+                : num_threads(0),
+                  stop_on_failure(false),
+                  decompressor(kDecompressorDefault) {}
+    };
+}
@@ -14,6 +14,7 @@ struct ZipString {
      * entry_name has to be an c-style string with only ASCII characters.
      */
     explicit ZipString(const char* entry_name){
+        name = reinterpret_cast<const uint8_t*>(entry_name);
         size_t len = strlen(entry_name);
         //CHECK_LE(len, static_cast<size_t>(UINT16_MAX));
         name_length = static_cast<uint16_t>(len);
@@ -23,6 +24,12 @@ struct ZipString {
         return name && (name_length == rhs.name_length) && (memcmp(name, rhs.name, name_length) == 0);
     }
 
+    // Lexicographic byte order, shorter names first on a common prefix.
+    bool operator<(const ZipString& rhs) const {
+        const int cmp = memcmp(name, rhs.name, name_length < rhs.name_length ? name_length : rhs.name_length);
+        return cmp < 0 || (cmp == 0 && name_length < rhs.name_length);
+    }
+
     bool StartsWith(const ZipString& prefix) const {
         return name && (name_length >= prefix.name_length) &&
                (memcmp(name, prefix.name, prefix.name_length) == 0);
@@ -0,0 +1,116 @@
+//
+// Created by season on 2021/7/13.
+//
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+
+#include <ChunkReader.h>
+#include <HLog.h>
+
+#define LOG_TAG "ChunkReader"
+
+namespace hms {
+    ChunkReader::ChunkReader(const MappedZipFile *zip, IoUring *ring, uint8_t *buffer,
+                             off64_t offset, uint64_t length)
+            : zip_(zip),
+              // Only a descriptor read with pread has anything to overlap.
+              ring_(zip->HasFd() && zip->GetArchiveMap() == nullptr ? ring : nullptr),
+              next_offset_(offset),
+              unrequested_(length),
+              remaining_(length),
+              token_(0),
+              pending_buffer_(nullptr),
+              pending_size_(0),
+              pending_offset_(0) {
+        buffers_[0] = buffer;
+        buffers_[1] = ring_ != nullptr ? ring_->GetReadAheadBuffer() : nullptr;
+    }
+
+    ChunkReader::~ChunkReader() {
+        if (token_ != 0) {
+            int32_t result;
+            ring_->Wait(token_, &result);
+        }
+    }
+
+    bool ChunkReader::StartRead(uint8_t *buffer) {
+        const size_t size = unrequested_ > IoUring::kBufferSize
+                            ? IoUring::kBufferSize : static_cast<size_t>(unrequested_);
+        token_ = ring_->PrepareRead(zip_->GetFileDescriptor(), buffer, size, next_offset_);
+        if (token_ == 0 || !ring_->Submit()) {
+            return false;
+        }
+        pending_buffer_ = buffer;
+        pending_size_ = size;
+        pending_offset_ = next_offset_;
+        next_offset_ += size;
+        unrequested_ -= size;
+        return true;
+    }
+
+    bool ChunkReader::FinishRead(uint8_t **buffer, size_t *size) {
+        int32_t result;
+        const bool waited = ring_->Wait(token_, &result);
+        token_ = 0;
+        if (!waited) {
+            return false;
+        }
+        if (result < 0) {
+            errno = -result;
+            return false;
+        }
+        // A short read leaves the rest to pread.
+        const size_t done = static_cast<size_t>(result);
+        if (done < pending_size_ &&
+            !zip_->ReadAtOffset(pending_buffer_ + done, pending_size_ - done,
+                                pending_offset_ + done)) {
+            return false;
+        }
+        *buffer = pending_buffer_;
+        *size = pending_size_;
+        return true;
+    }
+
+    bool ChunkReader::Next(const uint8_t **data, size_t *size) {
+        if (remaining_ == 0) {
+            return false;
+        }
+
+        if (ring_ == nullptr) {
+            const size_t chunk = remaining_ > IoUring::kBufferSize
+                                 ? IoUring::kBufferSize : static_cast<size_t>(remaining_);
+            if (!zip_->ReadAtOffset(buffers_[0], chunk, next_offset_)) {
+                return false;
+            }
+            next_offset_ += chunk;
+            remaining_ -= chunk;
+            *data = buffers_[0];
+            *size = chunk;
+            return true;
+        }
+
+        if (token_ == 0 && !StartRead(buffers_[0])) {
+            HLOGW("Zip: unable to queue read at offset %" PRId64 ": %s",
+                  static_cast<int64_t>(next_offset_), strerror(errno));
+            return false;
+        }
+        uint8_t *chunk;
+        if (!FinishRead(&chunk, size)) {
+            HLOGW("Zip: read at offset %" PRId64 " failed: %s",
+                  static_cast<int64_t>(pending_offset_), strerror(errno));
+            return false;
+        }
+        remaining_ -= *size;
+
+        // Read ahead into the other buffer; the caller is done with it.
+        if (unrequested_ != 0 && !StartRead(chunk == buffers_[0] ? buffers_[1] : buffers_[0])) {
+            HLOGW("Zip: unable to queue read at offset %" PRId64 ": %s",
+                  static_cast<int64_t>(next_offset_), strerror(errno));
+            return false;
+        }
+        *data = chunk;
+        return true;
+    }
+}
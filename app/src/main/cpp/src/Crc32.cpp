@@ -0,0 +1,232 @@
+//
+// Created by season on 2021/7/11.
+//
+
+#include <cstring>
+
+#include "zlib.h"
+
+#include <Crc32.h>
+#include <HLog.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HMS_CRC32_PCLMUL 1
+#elif defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define HMS_CRC32_ARMV8 1
+#endif
+
+#define LOG_TAG "Crc32"
+
+namespace hms {
+    typedef uint32_t (*Crc32Function)(uint32_t crc, const uint8_t *data, size_t length);
+
+    static uint32_t Crc32Zlib(uint32_t crc, const uint8_t *data, size_t length) {
+        // zlib takes a 32-bit length on some platforms.
+        while (length > 0) {
+            const uInt chunk = length > 0x40000000 ? 0x40000000 : static_cast<uInt>(length);
+            crc = static_cast<uint32_t>(crc32(crc, data, chunk));
+            data += chunk;
+            length -= chunk;
+        }
+        return crc;
+    }
+
+#if defined(HMS_CRC32_PCLMUL)
+    // Fold 16-byte lanes with carry-less multiplies and finish with a Barrett
+    // reduction, after "Fast CRC Computation for Generic Polynomials Using
+    // PCLMULQDQ Instruction" (Intel, 2009). |length| must be a multiple of
+    // 16 and at least 64. |crc| is taken and returned without the final
+    // inversion.
+    __attribute__((target("sse4.1,pclmul")))
+    static uint32_t Crc32FoldPclmul(uint32_t crc, const uint8_t *data, size_t length) {
+        // Bit-reflected constants x^(4*128+32), x^(4*128-32), x^(128+32),
+        // x^(128-32), x^64 mod P(x), and the Barrett constants.
+        alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+        alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+        alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+        alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+        x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+        x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+        x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+        data += 64;
+        length -= 64;
+
+        // Four lanes in parallel while there are 64-byte blocks.
+        while (length >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+            y5 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+            y6 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+            y7 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+            y8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+            data += 64;
+            length -= 64;
+        }
+
+        // Fold the four lanes into one.
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        // Then any remaining 16-byte blocks.
+        while (length >= 16) {
+            x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+            data += 16;
+            length -= 16;
+        }
+
+        // Fold 128 bits down to 64.
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_srli_si128(x1, 8);
+        x1 = _mm_xor_si128(x1, x2);
+
+        x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits.
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+    }
+
+    static uint32_t Crc32Pclmul(uint32_t crc, const uint8_t *data, size_t length) {
+        if (length >= 64) {
+            const size_t folded = length & ~static_cast<size_t>(15);
+            crc = ~Crc32FoldPclmul(~crc, data, folded);
+            data += folded;
+            length -= folded;
+        }
+        return Crc32Zlib(crc, data, length);
+    }
+#endif  // HMS_CRC32_PCLMUL
+
+#if defined(HMS_CRC32_ARMV8)
+#if defined(__clang__)
+#define HMS_CRC32_TARGET __attribute__((target("crc")))
+#define HMS_CRC32B(crc, value) __builtin_arm_crc32b(crc, value)
+#define HMS_CRC32D(crc, value) __builtin_arm_crc32d(crc, value)
+#else
+#define HMS_CRC32_TARGET __attribute__((target("+crc")))
+#define HMS_CRC32B(crc, value) __builtin_aarch64_crc32b(crc, value)
+#define HMS_CRC32D(crc, value) __builtin_aarch64_crc32x(crc, value)
+#endif
+
+    // The ARMv8 CRC32 instructions use the Zip polynomial, 8 bytes at a time.
+    HMS_CRC32_TARGET
+    static uint32_t Crc32Armv8(uint32_t crc, const uint8_t *data, size_t length) {
+        crc = ~crc;
+        while (length > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+            crc = HMS_CRC32B(crc, *data++);
+            --length;
+        }
+        while (length >= 32) {
+            uint64_t words[4];
+            memcpy(words, data, sizeof(words));
+            crc = HMS_CRC32D(crc, words[0]);
+            crc = HMS_CRC32D(crc, words[1]);
+            crc = HMS_CRC32D(crc, words[2]);
+            crc = HMS_CRC32D(crc, words[3]);
+            data += 32;
+            length -= 32;
+        }
+        while (length >= 8) {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            crc = HMS_CRC32D(crc, word);
+            data += 8;
+            length -= 8;
+        }
+        while (length > 0) {
+            crc = HMS_CRC32B(crc, *data++);
+            --length;
+        }
+        return ~crc;
+    }
+#endif  // HMS_CRC32_ARMV8
+
+    struct Crc32Implementation {
+        Crc32Function function;
+        const char *name;
+    };
+
+    static Crc32Implementation SelectImplementation() {
+        Crc32Implementation impl = {Crc32Zlib, "zlib"};
+#if defined(HMS_CRC32_PCLMUL)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("pclmul")) {
+            impl.function = Crc32Pclmul;
+            impl.name = "pclmul";
+        }
+#elif defined(HMS_CRC32_ARMV8)
+        if ((getauxval(AT_HWCAP) & HWCAP_CRC32) != 0) {
+            impl.function = Crc32Armv8;
+            impl.name = "armv8-crc32";
+        }
+#endif
+        HLOGI("+++ crc32 implementation: %s", impl.name);
+        return impl;
+    }
+
+    static const Crc32Implementation &GetImplementation() {
+        // Initialized once, thread-safely, on first use.
+        static const Crc32Implementation impl = SelectImplementation();
+        return impl;
+    }
+
+    uint32_t Crc32::Update(uint32_t crc, const uint8_t *data, size_t length) {
+        return GetImplementation().function(crc, data, length);
+    }
+
+    const char *Crc32::GetImplementationName() {
+        return GetImplementation().name;
+    }
+}
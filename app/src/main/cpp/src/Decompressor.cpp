@@ -0,0 +1,58 @@
+//
+// Created by season on 2021/7/12.
+//
+
+#include <Decompressor.h>
+#include <DeflateDecoder.h>
+#include <HLog.h>
+
+#define LOG_TAG "Decompressor"
+
+namespace hms {
+    Decompressor *Decompressor::Get(DecompressorType type) {
+        static ZlibDecompressor zlib;
+        static DeflateDecompressor deflate;
+        if (type == kDecompressorDeflate) {
+            return &deflate;
+        }
+        return &zlib;
+    }
+
+    Decompressor::Result ZlibDecompressor::Decompress(InflateContext *context,
+                                                      const uint8_t *input, size_t input_length,
+                                                      uint8_t *output, size_t output_length) {
+        // Both ends are in memory, so one Z_FINISH call inflates the whole
+        // stream; output space is exactly the expected length.
+        z_stream *zstream = context->GetStream();
+        // zlib never writes through next_in; it is only const with ZLIB_CONST.
+        zstream->next_in = const_cast<uint8_t *>(input);
+        zstream->avail_in = static_cast<uInt>(input_length);
+        zstream->next_out = output;
+        zstream->avail_out = static_cast<uInt>(output_length);
+        const int zerr = inflate(zstream, Z_FINISH);
+        if (zerr != Z_STREAM_END) {
+            if (zerr == Z_BUF_ERROR && zstream->avail_out == 0) {
+                return kSizeMismatch;
+            }
+            HLOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)", zerr, zstream->next_in,
+                  zstream->avail_in, zstream->next_out, zstream->avail_out);
+            return kCorrupt;
+        }
+        return zstream->total_out == output_length ? kSuccess : kSizeMismatch;
+    }
+
+    Decompressor::Result DeflateDecompressor::Decompress(InflateContext * /* context */,
+                                                         const uint8_t *input, size_t input_length,
+                                                         uint8_t *output, size_t output_length) {
+        switch (DeflateDecoder::Decode(input, input_length, output, output_length)) {
+            case DeflateDecoder::kSuccess:
+                return kSuccess;
+            case DeflateDecoder::kSizeMismatch:
+                return kSizeMismatch;
+            default:
+                HLOGW("Zip: corrupt deflate stream (%zu bytes in, %zu out)", input_length,
+                      output_length);
+                return kCorrupt;
+        }
+    }
+}
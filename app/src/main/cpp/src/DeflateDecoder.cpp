@@ -0,0 +1,555 @@
+//
+// Created by season on 2021/7/12.
+//
+
+#include <cstring>
+
+#include <DeflateDecoder.h>
+
+namespace hms {
+    /*
+     * Decode table entries are 32 bits:
+     *   bits 0-7    bits to consume: the codeword length, or for a subtable
+     *               pointer the bits of the table it is in
+     *   bits 8-11   extra bits following the codeword, or subtable bits
+     *   bits 12-15  flags
+     *   bits 16-31  literal byte, length or distance base, precode symbol, or
+     *               index of the subtable
+     */
+    static const uint32_t kLiteral = 1u << 12;
+    static const uint32_t kEndOfBlock = 1u << 13;
+    static const uint32_t kSubtable = 1u << 14;
+    static const uint32_t kInvalid = 1u << 15;
+
+    static const unsigned kMaxCodeLength = 15;
+    static const unsigned kNumLitlenSymbols = 288;
+    static const unsigned kNumOffsetSymbols = 32;
+    static const unsigned kNumPrecodeSymbols = 19;
+
+    static const unsigned kLitlenTableBits = 10;
+    static const unsigned kOffsetTableBits = 8;
+    static const unsigned kPrecodeTableBits = 7;
+
+    // Main table plus the largest set of subtables a complete code can need:
+    // a subtable of 2^d entries takes at least d + 1 of the symbols.
+    static const size_t kLitlenTableSize = (1u << kLitlenTableBits) + 48 * 32;
+    static const size_t kOffsetTableSize = (1u << kOffsetTableBits) + 4 * 128;
+    static const size_t kPrecodeTableSize = 1u << kPrecodeTableBits;
+
+    static inline uint32_t MakeEntry(uint32_t value, uint32_t flags, uint32_t extra_bits,
+                                     uint32_t length) {
+        return value << 16 | flags | extra_bits << 8 | length;
+    }
+
+    static const uint16_t kLengthBase[] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+    };
+    static const uint8_t kLengthExtraBits[] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+    };
+    static const uint16_t kOffsetBase[] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+    };
+    static const uint8_t kOffsetExtraBits[] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+    };
+    static const uint8_t kPrecodeOrder[kNumPrecodeSymbols] = {
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+    };
+
+    // Decoded meaning of every symbol, without the codeword length.
+    struct SymbolEntries {
+        uint32_t litlen[kNumLitlenSymbols];
+        uint32_t offset[kNumOffsetSymbols];
+        uint32_t precode[kNumPrecodeSymbols];
+
+        SymbolEntries() {
+            for (uint32_t sym = 0; sym < kNumLitlenSymbols; ++sym) {
+                if (sym < 256) {
+                    litlen[sym] = MakeEntry(sym, kLiteral, 0, 0);
+                } else if (sym == 256) {
+                    litlen[sym] = MakeEntry(0, kEndOfBlock, 0, 0);
+                } else if (sym < 286) {
+                    litlen[sym] = MakeEntry(kLengthBase[sym - 257], 0,
+                                            kLengthExtraBits[sym - 257], 0);
+                } else {
+                    litlen[sym] = MakeEntry(0, kInvalid, 0, 0);
+                }
+            }
+            for (uint32_t sym = 0; sym < kNumOffsetSymbols; ++sym) {
+                offset[sym] = sym < 30 ? MakeEntry(kOffsetBase[sym], 0, kOffsetExtraBits[sym], 0)
+                                       : MakeEntry(0, kInvalid, 0, 0);
+            }
+            for (uint32_t sym = 0; sym < kNumPrecodeSymbols; ++sym) {
+                precode[sym] = MakeEntry(sym, 0, 0, 0);
+            }
+        }
+    };
+
+    static const SymbolEntries &GetSymbolEntries() {
+        static const SymbolEntries entries;
+        return entries;
+    }
+
+    static inline uint32_t ReverseBits(uint32_t code, unsigned length) {
+        uint32_t reversed = 0;
+        for (unsigned i = 0; i < length; ++i) {
+            reversed = (reversed << 1) | (code & 1);
+            code >>= 1;
+        }
+        return reversed;
+    }
+
+    /*
+     * Build the decode table of the canonical Huffman code given by the
+     * codeword |lengths| of |num_symbols| symbols. Codewords no longer than
+     * |table_bits| are replicated over the main table; longer ones go to a
+     * subtable per main table slot, sized for the longest codeword sharing
+     * that slot.
+     *
+     * As in zlib, an incomplete code is only accepted if it is empty or is a
+     * single one-bit codeword (and never for the precode); the missing
+     * codewords decode to kInvalid.
+     */
+    static bool BuildTable(const uint8_t *lengths, unsigned num_symbols,
+                           const uint32_t *symbol_entries, unsigned table_bits,
+                           bool allow_incomplete, uint32_t *table, size_t table_size) {
+        unsigned count[kMaxCodeLength + 1] = {0};
+        for (unsigned sym = 0; sym < num_symbols; ++sym) {
+            count[lengths[sym]]++;
+        }
+        count[0] = 0;
+
+        int left = 1;
+        unsigned max_length = 0;
+        for (unsigned len = 1; len <= kMaxCodeLength; ++len) {
+            left = (left << 1) - static_cast<int>(count[len]);
+            if (left < 0) {
+                return false;  // Over-subscribed.
+            }
+            if (count[len] != 0) {
+                max_length = len;
+            }
+        }
+        if (left > 0 && max_length > 1) {
+            return false;  // Incomplete.
+        }
+        if (left > 0 && !allow_incomplete) {
+            return false;
+        }
+
+        const uint32_t invalid = MakeEntry(0, kInvalid, 0, 0);
+        const uint32_t main_size = 1u << table_bits;
+        for (uint32_t i = 0; i < main_size; ++i) {
+            table[i] = invalid;
+        }
+        if (max_length == 0) {
+            return true;
+        }
+
+        uint32_t next_code[kMaxCodeLength + 2] = {0};
+        uint32_t code = 0;
+        for (unsigned len = 1; len < kMaxCodeLength; ++len) {
+            code = (code + count[len]) << 1;
+            next_code[len + 1] = code;
+        }
+
+        // Size the subtables: the longest codeword per main table slot.
+        uint8_t subtable_length[1u << kLitlenTableBits];
+        bool has_subtables = max_length > table_bits;
+        if (has_subtables) {
+            memset(subtable_length, 0, main_size);
+            uint32_t probe[kMaxCodeLength + 2];
+            memcpy(probe, next_code, sizeof(probe));
+            for (unsigned sym = 0; sym < num_symbols; ++sym) {
+                const unsigned len = lengths[sym];
+                if (len > table_bits) {
+                    const uint32_t slot = ReverseBits(probe[len]++, len) & (main_size - 1);
+                    if (len > subtable_length[slot]) {
+                        subtable_length[slot] = static_cast<uint8_t>(len);
+                    }
+                } else if (len != 0) {
+                    probe[len]++;
+                }
+            }
+
+            size_t next_subtable = main_size;
+            for (uint32_t slot = 0; slot < main_size; ++slot) {
+                if (subtable_length[slot] == 0) {
+                    continue;
+                }
+                const uint32_t bits = subtable_length[slot] - table_bits;
+                if (next_subtable + (1u << bits) > table_size) {
+                    return false;
+                }
+                table[slot] = MakeEntry(static_cast<uint32_t>(next_subtable), kSubtable, bits,
+                                        table_bits);
+                for (uint32_t i = 0; i < (1u << bits); ++i) {
+                    table[next_subtable + i] = invalid;
+                }
+                next_subtable += 1u << bits;
+            }
+        }
+
+        for (unsigned sym = 0; sym < num_symbols; ++sym) {
+            const unsigned len = lengths[sym];
+            if (len == 0) {
+                continue;
+            }
+            const uint32_t reversed = ReverseBits(next_code[len]++, len);
+            if (len <= table_bits) {
+                const uint32_t entry = symbol_entries[sym] | len;
+                for (uint32_t i = reversed; i < main_size; i += 1u << len) {
+                    table[i] = entry;
+                }
+            } else {
+                const uint32_t pointer = table[reversed & (main_size - 1)];
+                const uint32_t start = pointer >> 16;
+                const uint32_t size = 1u << ((pointer >> 8) & 0xf);
+                const uint32_t entry = symbol_entries[sym] | (len - table_bits);
+                for (uint32_t i = reversed >> table_bits; i < size; i += 1u << (len - table_bits)) {
+                    table[start + i] = entry;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Tables of the fixed Huffman codes (BTYPE 01), built once.
+    struct FixedTables {
+        uint32_t litlen[kLitlenTableSize];
+        uint32_t offset[kOffsetTableSize];
+
+        FixedTables() {
+            uint8_t lengths[kNumLitlenSymbols];
+            for (unsigned sym = 0; sym < kNumLitlenSymbols; ++sym) {
+                lengths[sym] = sym < 144 ? 8 : sym < 256 ? 9 : sym < 280 ? 7 : 8;
+            }
+            BuildTable(lengths, kNumLitlenSymbols, GetSymbolEntries().litlen, kLitlenTableBits,
+                       false, litlen, kLitlenTableSize);
+            memset(lengths, 5, kNumOffsetSymbols);
+            BuildTable(lengths, kNumOffsetSymbols, GetSymbolEntries().offset, kOffsetTableBits,
+                       false, offset, kOffsetTableSize);
+        }
+    };
+
+    static const FixedTables &GetFixedTables() {
+        static const FixedTables tables;
+        return tables;
+    }
+
+    static inline uint64_t LoadLittleEndian64(const uint8_t *p) {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        value = __builtin_bswap64(value);
+#endif
+        return value;
+    }
+
+    /*
+     * LSB-first bit reader over the whole input. After Refill() at least 56
+     * bits are buffered; past the end of the input the buffer is padded with
+     * zero bytes, which are counted so that consuming them can be detected.
+     */
+    struct BitReader {
+        const uint8_t *in;
+        const uint8_t *const in_end;
+        uint64_t bits;
+        unsigned count;
+        size_t overrun;
+
+        BitReader(const uint8_t *input, size_t length)
+                : in(input), in_end(input + length), bits(0), count(0), overrun(0) {}
+
+        inline void Refill() {
+            if (in_end - in >= 8) {
+                // Bytes loaded beyond the new |count| are the ones |in| now
+                // points at, so the next load ORs in the same values.
+                bits |= LoadLittleEndian64(in) << count;
+                in += (63 - count) >> 3;
+                count |= 56;
+            } else {
+                while (count <= 56) {
+                    if (in < in_end) {
+                        bits |= static_cast<uint64_t>(*in++) << count;
+                    } else {
+                        overrun++;
+                    }
+                    count += 8;
+                }
+            }
+        }
+
+        inline uint32_t Peek(unsigned n) const {
+            return static_cast<uint32_t>(bits) & ((1u << n) - 1);
+        }
+
+        inline void Consume(unsigned n) {
+            bits >>= n;
+            count -= n;
+        }
+
+        inline uint32_t Pop(unsigned n) {
+            const uint32_t value = Peek(n);
+            Consume(n);
+            return value;
+        }
+
+        // True if padding bytes past the end of the input were consumed.
+        inline bool Overran() const {
+            return overrun * 8 > count;
+        }
+    };
+
+    static bool ReadDynamicTables(BitReader *br, uint32_t *litlen, uint32_t *offset) {
+        const SymbolEntries &entries = GetSymbolEntries();
+
+        br->Refill();
+        const unsigned num_litlen = br->Pop(5) + 257;
+        const unsigned num_offset = br->Pop(5) + 1;
+        const unsigned num_precode = br->Pop(4) + 4;
+        if (num_litlen > 286 || num_offset > 30) {
+            return false;
+        }
+
+        uint8_t precode_lengths[kNumPrecodeSymbols] = {0};
+        for (unsigned i = 0; i < num_precode; ++i) {
+            if (br->count < 3) {
+                br->Refill();
+            }
+            precode_lengths[kPrecodeOrder[i]] = static_cast<uint8_t>(br->Pop(3));
+        }
+
+        uint32_t precode[kPrecodeTableSize];
+        if (!BuildTable(precode_lengths, kNumPrecodeSymbols, entries.precode, kPrecodeTableBits,
+                        false, precode, kPrecodeTableSize)) {
+            return false;
+        }
+
+        uint8_t lengths[kNumLitlenSymbols + kNumOffsetSymbols];
+        const unsigned total = num_litlen + num_offset;
+        unsigned i = 0;
+        while (i < total) {
+            // A precode symbol and its repeat count take at most 14 bits.
+            if (br->count < 14) {
+                br->Refill();
+            }
+            const uint32_t entry = precode[br->Peek(kPrecodeTableBits)];
+            br->Consume(entry & 0xff);
+            const uint32_t sym = entry >> 16;
+            if (sym < 16) {
+                lengths[i++] = static_cast<uint8_t>(sym);
+                continue;
+            }
+
+            uint8_t value = 0;
+            unsigned repeat;
+            if (sym == 16) {
+                if (i == 0) {
+                    return false;
+                }
+                value = lengths[i - 1];
+                repeat = 3 + br->Pop(2);
+            } else if (sym == 17) {
+                repeat = 3 + br->Pop(3);
+            } else {
+                repeat = 11 + br->Pop(7);
+            }
+            if (repeat > total - i) {
+                return false;
+            }
+            memset(lengths + i, value, repeat);
+            i += repeat;
+        }
+
+        if (lengths[256] == 0) {
+            return false;  // No end-of-block code.
+        }
+        return BuildTable(lengths, num_litlen, entries.litlen, kLitlenTableBits, true,
+                          litlen, kLitlenTableSize) &&
+               BuildTable(lengths + num_litlen, num_offset, entries.offset, kOffsetTableBits,
+                          true, offset, kOffsetTableSize);
+    }
+
+    static const size_t kMinWordCopyDistance = 32;
+
+    // Copy a |length| byte match from |distance| bytes back. Writes up to 7
+    // bytes past the match when there is room for them; later output
+    // overwrites them.
+    static inline void CopyMatch(uint8_t *dst, size_t distance, size_t length,
+                                 const uint8_t *out_end) {
+        const uint8_t *src = dst - distance;
+        uint8_t *const end = dst + length;
+        if (distance == 1) {
+            memset(dst, *src, length);
+            return;
+        }
+        if (out_end - end < 8) {
+            while (dst < end) {
+                *dst++ = *src++;
+            }
+            return;
+        }
+        if (distance < kMinWordCopyDistance) {
+            // The match repeats with period |distance|, so once the first
+            // multiple of the period past kMinWordCopyDistance is written the
+            // rest can be copied a word at a time from that far back. Loading
+            // words that straddle the stores just made would stall store
+            // forwarding, hence more than the 8 bytes a word needs.
+            const size_t stride = distance * ((kMinWordCopyDistance + distance - 1) / distance);
+            uint8_t *const prefix_end = dst + stride < end ? dst + stride : end;
+            while (dst < prefix_end) {
+                *dst++ = *src++;
+            }
+            src = dst - stride;
+        }
+        while (dst < end) {
+            uint64_t word;
+            memcpy(&word, src, sizeof(word));
+            memcpy(dst, &word, sizeof(word));
+            src += 8;
+            dst += 8;
+        }
+    }
+
+    // Running out of room is reported as corruption when the decoder is
+    // already reading padding: the stream was truncated.
+    static inline DeflateDecoder::Result SizeMismatch(const BitReader &br) {
+        return br.Overran() ? DeflateDecoder::kCorrupt : DeflateDecoder::kSizeMismatch;
+    }
+
+    DeflateDecoder::Result DeflateDecoder::Decode(const uint8_t *input, size_t input_length,
+                                                  uint8_t *output, size_t output_length) {
+        BitReader br(input, input_length);
+        uint8_t *out = output;
+        uint8_t *const out_end = output + output_length;
+
+        uint32_t dynamic_litlen[kLitlenTableSize];
+        uint32_t dynamic_offset[kOffsetTableSize];
+
+        bool final_block;
+        do {
+            br.Refill();
+            if (br.Overran()) {
+                return kCorrupt;
+            }
+            final_block = br.Pop(1) != 0;
+            const uint32_t type = br.Pop(2);
+
+            const uint32_t *litlen;
+            const uint32_t *offset;
+            if (type == 0) {
+                // Stored block: realign to the byte after the header and hand
+                // the buffered bytes back to the input.
+                br.Consume(br.count & 7);
+                if (br.Overran()) {
+                    return kCorrupt;
+                }
+                br.in -= br.count / 8 - br.overrun;
+                br.bits = 0;
+                br.count = 0;
+                br.overrun = 0;
+
+                if (br.in_end - br.in < 4) {
+                    return kCorrupt;
+                }
+                const size_t length = br.in[0] | br.in[1] << 8;
+                const size_t inverse = br.in[2] | br.in[3] << 8;
+                if (length != (~inverse & 0xffff)) {
+                    return kCorrupt;
+                }
+                br.in += 4;
+                if (static_cast<size_t>(br.in_end - br.in) < length) {
+                    return kCorrupt;
+                }
+                if (static_cast<size_t>(out_end - out) < length) {
+                    return kSizeMismatch;
+                }
+                if (length > 0) {
+                    memcpy(out, br.in, length);
+                }
+                br.in += length;
+                out += length;
+                continue;
+            } else if (type == 1) {
+                litlen = GetFixedTables().litlen;
+                offset = GetFixedTables().offset;
+            } else if (type == 2) {
+                if (!ReadDynamicTables(&br, dynamic_litlen, dynamic_offset)) {
+                    return kCorrupt;
+                }
+                litlen = dynamic_litlen;
+                offset = dynamic_offset;
+            } else {
+                return kCorrupt;
+            }
+
+            for (;;) {
+                // One refill covers the longest literal/length codeword, its
+                // extra bits, the distance codeword and its extra bits:
+                // 15 + 5 + 15 + 13 = 48 bits.
+                br.Refill();
+                uint32_t entry = litlen[br.Peek(kLitlenTableBits)];
+                if (entry & kSubtable) {
+                    br.Consume(kLitlenTableBits);
+                    entry = litlen[(entry >> 16) + br.Peek((entry >> 8) & 0xf)];
+                }
+                br.Consume(entry & 0xff);
+
+                if (entry & kLiteral) {
+                    if (out == out_end) {
+                        return SizeMismatch(br);
+                    }
+                    *out++ = static_cast<uint8_t>(entry >> 16);
+
+                    // At least 41 bits are left: enough for another literal
+                    // without a refill.
+                    entry = litlen[br.Peek(kLitlenTableBits)];
+                    if ((entry & kLiteral) && out != out_end) {
+                        br.Consume(entry & 0xff);
+                        *out++ = static_cast<uint8_t>(entry >> 16);
+                    }
+                    continue;
+                }
+                if (entry & (kEndOfBlock | kInvalid)) {
+                    if (entry & kInvalid) {
+                        return kCorrupt;
+                    }
+                    break;
+                }
+
+                const size_t length = (entry >> 16) + br.Pop((entry >> 8) & 0xf);
+
+                entry = offset[br.Peek(kOffsetTableBits)];
+                if (entry & kSubtable) {
+                    br.Consume(kOffsetTableBits);
+                    entry = offset[(entry >> 16) + br.Peek((entry >> 8) & 0xf)];
+                }
+                br.Consume(entry & 0xff);
+                if (entry & kInvalid) {
+                    return kCorrupt;
+                }
+                const size_t distance = (entry >> 16) + br.Pop((entry >> 8) & 0xf);
+
+                if (distance > static_cast<size_t>(out - output)) {
+                    return kCorrupt;
+                }
+                if (length > static_cast<size_t>(out_end - out)) {
+                    return SizeMismatch(br);
+                }
+                CopyMatch(out, distance, length, out_end);
+                out += length;
+            }
+        } while (!final_block);
+
+        if (br.Overran()) {
+            return kCorrupt;
+        }
+        return out == out_end ? kSuccess : kSizeMismatch;
+    }
+}
@@ -0,0 +1,175 @@
+//
+// Created by season on 2021/7/6.
+//
+
+#include <algorithm>
+#include <map>
+
+#include <DirectoryTree.h>
+#include <HLog.h>
+
+#define LOG_TAG "DirectoryTree"
+
+namespace hms {
+    // Returns the end of the path component starting at |pos|.
+    static uint16_t ComponentEnd(const uint8_t *path, uint16_t length, uint16_t pos) {
+        while (pos < length && path[pos] != '/') {
+            ++pos;
+        }
+        return pos;
+    }
+
+    // Returns the start of the next non-empty component at or after |pos|.
+    static uint16_t SkipSlashes(const uint8_t *path, uint16_t length, uint16_t pos) {
+        while (pos < length && path[pos] == '/') {
+            ++pos;
+        }
+        return pos;
+    }
+
+    uint32_t DirectoryTree::AddNode(uint32_t parent, const uint8_t *path, uint16_t name_offset,
+                                    uint16_t path_length, bool is_directory, int32_t ent,
+                                    uint32_t uncompressed_length) {
+        Node node;
+        node.path = path;
+        node.path_length = path_length;
+        node.name_offset = name_offset;
+        node.is_directory = is_directory;
+        node.is_synthetic = ent < 0;
+        node.entry_index = ent;
+        node.uncompressed_length = uncompressed_length;
+        nodes_.push_back(node);
+
+        const uint32_t idx = static_cast<uint32_t>(nodes_.size() - 1);
+        nodes_[parent].children.push_back(idx);
+        return idx;
+    }
+
+    void DirectoryTree::Build(const EntryIndex &index, const std::vector<uint16_t> &sorted_entries) {
+        HLOGENTRY();
+        nodes_.clear();
+        nodes_.reserve(sorted_entries.size() + 1);
+
+        Node root;
+        root.path = nullptr;
+        root.path_length = 0;
+        root.name_offset = 0;
+        root.is_directory = true;
+        root.is_synthetic = true;
+        root.entry_index = -1;
+        root.uncompressed_length = 0;
+        nodes_.push_back(root);
+
+        // Empty components are ignored, so names that differ only in their
+        // slashes ("/a/x", "a//x") share nodes but do not sort next to each
+        // other. Nodes are therefore found by parent and name, not by their
+        // position in |sorted_entries|.
+        std::map<ChildKey, uint32_t> known;
+        for (const uint16_t ent : sorted_entries) {
+            const ZipString entry_name = index.GetName(ent);
+            const uint8_t *path = entry_name.name;
+            const uint16_t length = entry_name.name_length;
+
+            uint32_t parent = 0;
+            uint16_t pos = SkipSlashes(path, length, 0);
+            while (pos < length) {
+                const uint16_t end = ComponentEnd(path, length, pos);
+                const uint16_t next = SkipSlashes(path, length, end);
+                // A name without a trailing slash ends in a file.
+                const bool is_directory = end != length;
+                ChildKey key;
+                key.parent = parent;
+                key.is_directory = is_directory;
+                key.name.name = path + pos;
+                key.name.name_length = end - pos;
+
+                const auto it = known.find(key);
+                if (it == known.end()) {
+                    // The entry of this node, if this is its last component.
+                    const int32_t node_ent = next == length ? ent : -1;
+                    const uint32_t node = AddNode(
+                            parent, path, pos, end, is_directory, node_ent,
+                            is_directory ? 0 : index.GetUncompressedLength(ent));
+                    known.insert(std::make_pair(key, node));
+                    parent = node;
+                } else {
+                    // Of several entries with the same path, the first in
+                    // name order is the one the tree refers to.
+                    Node &node = nodes_[it->second];
+                    if (next == length && is_directory && node.is_synthetic) {
+                        node.is_synthetic = false;
+                        node.entry_index = ent;
+                    } else if (next == length) {
+                        HLOGV("Zip: %.*s duplicates the path of another entry", length, path);
+                    }
+                    parent = it->second;
+                }
+                pos = next;
+            }
+        }
+
+        for (Node &node : nodes_) {
+            std::sort(node.children.begin(), node.children.end(),
+                      [this](uint32_t lhs, uint32_t rhs) {
+                          return nodes_[lhs].GetName() < nodes_[rhs].GetName();
+                      });
+        }
+        HLOGV("+++ directory tree has %zu nodes", nodes_.size());
+    }
+
+    int32_t DirectoryTree::Lookup(const ZipString &path) const {
+        if (nodes_.empty()) {
+            return -1;
+        }
+
+        uint32_t node = 0;
+        uint16_t pos = SkipSlashes(path.name, path.name_length, 0);
+        while (pos < path.name_length) {
+            const uint16_t end = ComponentEnd(path.name, path.name_length, pos);
+            const uint16_t next = SkipSlashes(path.name, path.name_length, end);
+            ZipString component;
+            component.name = path.name + pos;
+            component.name_length = end - pos;
+
+            const std::vector<uint32_t> &children = nodes_[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(), component,
+                                       [this](uint32_t child, const ZipString &value) {
+                                           return nodes_[child].GetName() < value;
+                                       });
+            // A file and a directory may share a name; only the directory can be
+            // descended into.
+            int32_t found = -1;
+            for (; it != children.end() && nodes_[*it].GetName() == component; ++it) {
+                if (found < 0 || (next < path.name_length && nodes_[*it].is_directory)) {
+                    found = static_cast<int32_t>(*it);
+                }
+            }
+            if (found < 0 || (next < path.name_length && !nodes_[found].is_directory)) {
+                return -1;
+            }
+            node = static_cast<uint32_t>(found);
+            pos = next;
+        }
+        return static_cast<int32_t>(node);
+    }
+
+    void DirectoryTree::GetDirEntry(uint32_t node, ZipDirEntry *out) const {
+        const Node &n = nodes_[node];
+        out->path.name = n.path;
+        out->path.name_length = n.path_length;
+        out->name = n.GetName();
+        out->is_directory = n.is_directory;
+        out->is_synthetic = n.is_synthetic;
+        out->child_count = static_cast<uint32_t>(n.children.size());
+        out->entry_index = n.entry_index;
+        out->uncompressed_length = n.uncompressed_length;
+    }
+
+    void DirectoryTree::ListChildren(uint32_t node, std::vector<ZipDirEntry> *out) const {
+        const std::vector<uint32_t> &children = nodes_[node].children;
+        out->resize(children.size());
+        for (size_t i = 0; i < children.size(); ++i) {
+            GetDirEntry(children[i], &(*out)[i]);
+        }
+    }
+}
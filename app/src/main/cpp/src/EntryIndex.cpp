@@ -0,0 +1,194 @@
+//
+// Created by season on 2021/7/4.
+//
+
+#include <cstdlib>
+#include <cstring>
+
+#include <EntryIndex.h>
+#include <HLog.h>
+
+#define LOG_TAG "EntryIndex"
+
+namespace hms {
+    /*
+     * Round up to the next highest power of 2.
+     *
+     * Found on http://graphics.stanford.edu/~seander/bithacks.html.
+     */
+    static uint32_t RoundUpPower2(uint32_t val) {
+        val--;
+        val |= val >> 1;
+        val |= val >> 2;
+        val |= val >> 4;
+        val |= val >> 8;
+        val |= val >> 16;
+        val++;
+
+        return val;
+    }
+
+    EntryIndex::EntryIndex()
+            : cd_ptr_(nullptr),
+              owned_(nullptr),
+              data_(nullptr),
+              num_entries_(0),
+              num_added_(0),
+              table_size_(0),
+              slot_hashes_(nullptr),
+              slot_entries_(nullptr),
+              cd_offsets_(nullptr) {
+    }
+
+    EntryIndex::~EntryIndex() {
+        free(owned_);
+    }
+
+    size_t EntryIndex::ByteSize(uint16_t num_entries, uint32_t table_size) {
+        return table_size * (sizeof(uint32_t) + sizeof(uint16_t)) +
+               num_entries * sizeof(uint32_t);
+    }
+
+    /*
+     * Hash a name a machine word at a time. This is both cheaper than the
+     * classic "hash * 31 + c" byte loop and spreads the common shared prefixes
+     * of entry names ("res/", "lib/arm64-v8a/") across the whole table.
+     */
+    uint32_t EntryIndex::ComputeHash(const uint8_t *name, uint16_t length) {
+        uint64_t hash = 0x9e3779b97f4a7c15ULL ^ length;
+        while (length >= sizeof(uint64_t)) {
+            hash = (hash ^ get_unaligned<uint64_t>(name)) * 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 32;
+            name += sizeof(uint64_t);
+            length -= sizeof(uint64_t);
+        }
+
+        uint64_t tail = 0;
+        memcpy(&tail, name, length);
+        hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 29;
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    void EntryIndex::Layout(uint8_t *base) {
+        // 32-bit arrays first so that every array stays naturally aligned.
+        slot_hashes_ = reinterpret_cast<uint32_t *>(base);
+        cd_offsets_ = slot_hashes_ + table_size_;
+        slot_entries_ = reinterpret_cast<uint16_t *>(cd_offsets_ + num_entries_);
+    }
+
+    bool EntryIndex::Allocate(const uint8_t *cd_ptr, uint16_t num_entries) {
+        /*
+         * We have a minimum 75% load factor, possibly as low as 50% after we
+         * round off to a power of 2. There must be at least one unused entry to
+         * avoid an infinite loop during creation.
+         */
+        const uint32_t table_size = RoundUpPower2(1 + (num_entries * 4) / 3);
+        uint8_t *block = reinterpret_cast<uint8_t *>(malloc(ByteSize(num_entries, table_size)));
+        if (block == nullptr) {
+            HLOGW("Zip: unable to allocate the %u-slot index for %u entries", table_size,
+                  num_entries);
+            return false;
+        }
+
+        free(owned_);
+        owned_ = block;
+        data_ = block;
+        cd_ptr_ = cd_ptr;
+        num_entries_ = num_entries;
+        num_added_ = 0;
+        table_size_ = table_size;
+        Layout(block);
+        memset(slot_entries_, 0xff, table_size * sizeof(uint16_t));
+        return true;
+    }
+
+    bool EntryIndex::Attach(const uint8_t *cd_ptr, size_t cd_size, const void *data, size_t size,
+                            uint16_t num_entries, uint32_t table_size) {
+        if (table_size == 0 || (table_size & (table_size - 1)) != 0 ||
+            table_size <= num_entries || size != ByteSize(num_entries, table_size)) {
+            HLOGW("Zip: bad index geometry (%u entries, %u slots, %zu bytes)", num_entries,
+                  table_size, size);
+            return false;
+        }
+
+        free(owned_);
+        owned_ = nullptr;
+        data_ = data;
+        cd_ptr_ = cd_ptr;
+        num_entries_ = num_entries;
+        num_added_ = num_entries;
+        table_size_ = table_size;
+        // The arrays are only ever read once attached.
+        Layout(reinterpret_cast<uint8_t *>(const_cast<void *>(data)));
+
+        // Probes stop at an empty slot, so one has to be left.
+        uint32_t used = 0;
+        for (uint32_t i = 0; i < table_size; ++i) {
+            if (slot_entries_[i] == kEmptySlot) {
+                continue;
+            }
+            if (slot_entries_[i] >= num_entries) {
+                HLOGW("Zip: bad index slot %u", i);
+                data_ = nullptr;
+                return false;
+            }
+            ++used;
+        }
+        if (used != num_entries) {
+            HLOGW("Zip: index has %u slots in use for %u entries", used, num_entries);
+            data_ = nullptr;
+            return false;
+        }
+        for (uint32_t i = 0; i < num_entries; ++i) {
+            // The record header first, then the name it gives the length of.
+            if (static_cast<uint64_t>(cd_offsets_[i]) + sizeof(CentralDirectoryRecord) > cd_size ||
+                cd_offsets_[i] + sizeof(CentralDirectoryRecord) +
+                GetRecord(i)->file_name_length > cd_size) {
+                HLOGW("Zip: bad index entry %u", i);
+                data_ = nullptr;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool EntryIndex::Add(const CentralDirectoryRecord *cdr) {
+        const uint8_t *name = reinterpret_cast<const uint8_t *>(cdr + 1);
+        const uint16_t name_length = cdr->file_name_length;
+        const uint32_t hash = ComputeHash(name, name_length);
+        uint32_t ent = hash & (table_size_ - 1);
+
+        /*
+         * We over-allocated the table, so we're guaranteed to find an empty slot.
+         */
+        uint16_t idx;
+        while ((idx = slot_entries_[ent]) != kEmptySlot) {
+            if (slot_hashes_[ent] == hash && GetRecord(idx)->file_name_length == name_length &&
+                memcmp(GetName(idx).name, name, name_length) == 0) {
+                return false;
+            }
+            ent = (ent + 1) & (table_size_ - 1);
+        }
+
+        idx = num_added_++;
+        slot_hashes_[ent] = hash;
+        slot_entries_[ent] = idx;
+        cd_offsets_[idx] = static_cast<uint32_t>(reinterpret_cast<const uint8_t *>(cdr) - cd_ptr_);
+        return true;
+    }
+
+    int32_t EntryIndex::Find(const ZipString &name) const {
+        const uint32_t hash = ComputeHash(name.name, name.name_length);
+        uint32_t ent = hash & (table_size_ - 1);
+        uint16_t idx;
+        while ((idx = slot_entries_[ent]) != kEmptySlot) {
+            if (slot_hashes_[ent] == hash && GetRecord(idx)->file_name_length == name.name_length &&
+                memcmp(GetName(idx).name, name.name, name.name_length) == 0) {
+                return idx;
+            }
+            ent = (ent + 1) & (table_size_ - 1);
+        }
+        return -1;
+    }
+}
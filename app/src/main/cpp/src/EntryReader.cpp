@@ -0,0 +1,192 @@
+//
+// Created by season on 2021/7/15.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+
+#include <EntryReader.h>
+#include <Crc32.h>
+#include <ZipFile.h>
+#include <HLog.h>
+
+#define LOG_TAG "EntryReader"
+
+namespace hms {
+    void EntryReader::Reset() {
+        zip_ = nullptr;
+        context_.reset();
+        deflated_ = false;
+        check_crc_ = false;
+        expected_crc_ = 0;
+        mapped_ = nullptr;
+        input_offset_ = 0;
+        input_remaining_ = 0;
+        stream_end_ = false;
+        unproduced_ = 0;
+        remaining_ = 0;
+        window_ = nullptr;
+        window_avail_ = 0;
+        crc_ = 0;
+        error_ = 0;
+    }
+
+    int64_t EntryReader::Read(void *buf, size_t len) {
+        return Consume(static_cast<uint8_t *>(buf), len);
+    }
+
+    int64_t EntryReader::Skip(uint64_t len) {
+        return Consume(nullptr, len);
+    }
+
+    int64_t EntryReader::Consume(uint8_t *out, uint64_t len) {
+        if (zip_ == nullptr) {
+            return kInvalidHandle;
+        }
+        if (error_ != 0) {
+            return error_;
+        }
+
+        const size_t kWindowSize = InflateContext::kBufferSize;
+        len = std::min(len, remaining_);
+        uint64_t done = 0;
+        while (done < len) {
+            if (window_avail_ == 0) {
+                // With the window empty, everything left is unproduced.
+                const uint64_t wanted = len - done;
+                int32_t error = 0;
+                if (out == nullptr && !deflated_ && !check_crc_) {
+                    // Stored data skipped unchecked is not read at all.
+                    mapped_ = mapped_ != nullptr ? mapped_ + wanted : nullptr;
+                    input_offset_ += wanted;
+                    input_remaining_ -= wanted;
+                    unproduced_ -= wanted;
+                    done = len;
+                    break;
+                } else if (out != nullptr && (!deflated_ || wanted >= kWindowSize)) {
+                    // Stored data and large reads bypass the window.
+                    const size_t size = static_cast<size_t>(std::min<uint64_t>(wanted, SIZE_MAX));
+                    error = Produce(out + done, size);
+                    done += size;
+                } else {
+                    const size_t size = static_cast<size_t>(
+                            std::min<uint64_t>(unproduced_, kWindowSize));
+                    error = Produce(context_->GetWriteBuffer(), size);
+                    window_ = context_->GetWriteBuffer();
+                    window_avail_ = size;
+                }
+                if (error != 0) {
+                    error_ = error;
+                    return error;
+                }
+                continue;
+            }
+
+            const size_t size = static_cast<size_t>(std::min<uint64_t>(window_avail_, len - done));
+            if (out != nullptr) {
+                memcpy(out + done, window_, size);
+            }
+            window_ += size;
+            window_avail_ -= size;
+            done += size;
+        }
+
+        remaining_ -= done;
+        return static_cast<int64_t>(done);
+    }
+
+    int32_t EntryReader::Produce(uint8_t *out, size_t len) {
+        if (deflated_) {
+            size_t produced;
+            const int32_t error = Inflate(out, len, &produced);
+            if (error != 0) {
+                return error;
+            }
+            if (produced != len) {
+                HLOGW("Zip: inflated data ends early, %" PRIu64 " bytes short",
+                      unproduced_ - produced);
+                return kInconsistentInformation;
+            }
+        } else {
+            if (mapped_ != nullptr) {
+                memcpy(out, mapped_, len);
+                mapped_ += len;
+            } else if (!zip_->ReadAtOffset(out, len, input_offset_)) {
+                HLOGW("Zip: read of %zu bytes failed: %s", len, strerror(errno));
+                return kIoError;
+            }
+            input_offset_ += len;
+            input_remaining_ -= len;
+        }
+
+        if (check_crc_) {
+            crc_ = Crc32::Update(crc_, out, len);
+        }
+        unproduced_ -= len;
+        return unproduced_ == 0 ? Finish() : 0;
+    }
+
+    int32_t EntryReader::Inflate(uint8_t *out, size_t len, size_t *produced) {
+        const size_t kBufSize = InflateContext::kBufferSize;
+        z_stream &zstream = *context_->GetStream();
+        zstream.next_out = out;
+        zstream.avail_out = static_cast<uInt>(len);
+        while (zstream.avail_out != 0 && !stream_end_) {
+            if (zstream.avail_in == 0 && input_remaining_ != 0) {
+                if (mapped_ != nullptr) {
+                    // zlib never writes through next_in; it is only const with ZLIB_CONST.
+                    zstream.next_in = const_cast<uint8_t *>(mapped_);
+                    zstream.avail_in = static_cast<uInt>(input_remaining_);
+                    input_remaining_ = 0;
+                } else {
+                    const size_t chunk = static_cast<size_t>(
+                            std::min<uint64_t>(input_remaining_, kBufSize));
+                    uint8_t *const read_buf = context_->GetReadBuffer();
+                    if (!zip_->ReadAtOffset(read_buf, chunk, input_offset_)) {
+                        HLOGW("Zip: inflate read failed: %s", strerror(errno));
+                        return kIoError;
+                    }
+                    input_offset_ += chunk;
+                    input_remaining_ -= chunk;
+                    zstream.next_in = read_buf;
+                    zstream.avail_in = static_cast<uInt>(chunk);
+                }
+            }
+
+            const int zerr = inflate(&zstream, Z_NO_FLUSH);
+            if (zerr == Z_STREAM_END) {
+                stream_end_ = true;
+            } else if (zerr != Z_OK) {
+                HLOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)", zerr,
+                      zstream.next_in, zstream.avail_in, zstream.next_out, zstream.avail_out);
+                return kZlibError;
+            }
+        }
+        *produced = len - zstream.avail_out;
+        return 0;
+    }
+
+    int32_t EntryReader::Finish() {
+        if (deflated_) {
+            // The stream has to end exactly at the declared length.
+            uint8_t extra;
+            size_t produced;
+            const int32_t error = Inflate(&extra, 1, &produced);
+            if (error != 0) {
+                return error;
+            }
+            if (produced != 0 || input_remaining_ != 0) {
+                HLOGW("Zip: inflated data does not end at its declared length");
+                return kInconsistentInformation;
+            }
+        }
+
+        if (check_crc_ && crc_ != expected_crc_) {
+            HLOGW("Zip: crc mismatch: expected %" PRIu32 ", was %" PRIu32, expected_crc_, crc_);
+            return kInconsistentInformation;
+        }
+        return 0;
+    }
+}
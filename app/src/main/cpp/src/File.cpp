@@ -17,9 +17,11 @@
 #include "File.h"
 
 #include <cerrno>
+#include <cstdlib>
 #include <fcntl.h>
 #include <libgen.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -46,6 +48,65 @@ namespace hms {
         return true;
     }
 
+    int File::CreateTemp(const std::string &path, std::string *tmp_path) {
+        // mkostemp is only available from API 23.
+        std::string name = path + ".XXXXXX";
+        const int fd = mkstemp(&name[0]);
+        if (fd == -1) {
+            return -1;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        tmp_path->swap(name);
+        return fd;
+    }
+
+    bool File::SyncRange(int fd, off64_t offset, off64_t length, bool wait) {
+        const unsigned int flags = wait ? SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                                          SYNC_FILE_RANGE_WAIT_AFTER
+                                        : SYNC_FILE_RANGE_WRITE;
+#if defined(__ANDROID_API__) && __ANDROID_API__ >= 26
+        return sync_file_range(fd, offset, length, flags) == 0;
+#else
+        // Called through syscall(2): bionic only wraps it from API 26. 32-bit
+        // ARM takes the flags second, to keep the 64-bit arguments aligned.
+#if defined(__LP64__)
+#define SPLIT_OFF64(value) (value)
+#else
+        // syscall(2) hands its arguments to the kernel word by word, so each
+        // 64-bit value is passed as its own two halves, low word first on
+        // these little-endian ABIs, as bionic's syscall stubs do.
+#define SPLIT_OFF64(value) \
+        static_cast<uint32_t>(static_cast<uint64_t>(value)), \
+        static_cast<uint32_t>(static_cast<uint64_t>(value) >> 32)
+#endif
+#if defined(__NR_sync_file_range2)
+        const long result = syscall(__NR_sync_file_range2, fd, flags,
+                                    SPLIT_OFF64(offset), SPLIT_OFF64(length));
+#elif defined(__NR_sync_file_range)
+        const long result = syscall(__NR_sync_file_range, fd,
+                                    SPLIT_OFF64(offset), SPLIT_OFF64(length), flags);
+#else
+        errno = ENOSYS;
+        const long result = -1;
+#endif
+#undef SPLIT_OFF64
+        return result == 0;
+#endif
+    }
+
+    bool File::DropRange(int fd, off64_t offset, off64_t length) {
+        // DONTNEED skips dirty pages, so they have to be written back first.
+        if (!SyncRange(fd, offset, length, true)) {
+            return false;
+        }
+        const int error = posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+        if (error != 0) {
+            errno = error;
+            return false;
+        }
+        return true;
+    }
+
     std::string File::Dirname(const std::string &path) {
         // Copy path because dirname may modify the string passed in.
         std::string result(path);
@@ -61,4 +122,56 @@ namespace hms {
 
         return result;
     }
+
+    int File::OpenDirBeneath(int dir_fd, const std::string &path, bool create) {
+        const int kFlags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+        int fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+        size_t start = 0;
+        while (fd != -1 && start < path.size()) {
+            size_t end = path.find('/', start);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            if (end > start) {
+                const std::string component = path.substr(start, end - start);
+                int next = TEMP_FAILURE_RETRY(openat(fd, component.c_str(), kFlags));
+                if (next == -1 && errno == ENOENT && create &&
+                    (mkdirat(fd, component.c_str(), 0777) == 0 || errno == EEXIST)) {
+                    next = TEMP_FAILURE_RETRY(openat(fd, component.c_str(), kFlags));
+                }
+                struct stat sb{};
+                if (next == -1 && errno == ENOTDIR &&
+                    fstatat(fd, component.c_str(), &sb, AT_SYMLINK_NOFOLLOW) == 0 &&
+                    S_ISLNK(sb.st_mode)) {
+                    // O_DIRECTORY wins over O_NOFOLLOW in the error reported.
+                    errno = ELOOP;
+                }
+                const int saved_errno = errno;
+                close(fd);
+                errno = saved_errno;
+                fd = next;
+            }
+            start = end + 1;
+        }
+        return fd;
+    }
+
+    bool File::MakeDirs(const std::string &path) {
+        struct stat sb{};
+        if (stat(path.c_str(), &sb) != -1 && S_ISDIR(sb.st_mode)) {
+            return true;
+        }
+
+        // 递归创建目录，现保证父目录创建成功
+        const std::string parent = Dirname(path);
+        if (parent != path && !MakeDirs(parent)) {
+            return false;
+        }
+
+        // 最后创建此目录
+        if (mkdir(path.c_str(), 0777) != -1) {
+            return true;
+        }
+        return errno == EEXIST && stat(path.c_str(), &sb) != -1 && S_ISDIR(sb.st_mode);
+    }
 }
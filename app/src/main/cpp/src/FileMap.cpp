@@ -122,4 +122,51 @@ namespace hms {
         return true;
     }
 
-}
\ No newline at end of file
+    // Map one of the MapAdvice values onto its madvise(2) flag.
+    static int ToMadvise(FileMap::MapAdvice advice) {
+        switch (advice) {
+            case FileMap::RANDOM:
+                return MADV_RANDOM;
+            case FileMap::SEQUENTIAL:
+                return MADV_SEQUENTIAL;
+            case FileMap::WILLNEED:
+                return MADV_WILLNEED;
+            case FileMap::DONTNEED:
+                return MADV_DONTNEED;
+            case FileMap::NORMAL:
+            default:
+                return MADV_NORMAL;
+        }
+    }
+
+// Provide guidance to the system.
+    int FileMap::advise(MapAdvice advice)
+    {
+        const int cc = madvise(mBasePtr, mBaseLength, ToMadvise(advice));
+        if (cc != 0) {
+            HLOGW("madvise(%d) failed: %s\n", advice, strerror(errno));
+        }
+        return cc;
+    }
+
+    int FileMap::advise(MapAdvice advice, size_t offset, size_t length)
+    {
+        if (mBasePtr == NULL || offset > mDataLength) {
+            return -1;
+        }
+        if (length > mDataLength - offset) {
+            length = mDataLength - offset;
+        }
+
+        // madvise needs a page aligned start; mBasePtr is one.
+        const size_t start = static_cast<char*>(mDataPtr) - static_cast<char*>(mBasePtr) + offset;
+        const size_t adjust = start % mPageSize;
+        const int cc = madvise(static_cast<char*>(mBasePtr) + start - adjust, length + adjust,
+                               ToMadvise(advice));
+        if (cc != 0) {
+            HLOGW("madvise(%d) failed: %s\n", advice, strerror(errno));
+        }
+        return cc;
+    }
+
+}
@@ -0,0 +1,105 @@
+//
+// Created by season on 2021/7/3.
+//
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <File.h>
+#include <Macros.h>
+#include <IndexCache.h>
+#include <HLog.h>
+
+#define LOG_TAG "IndexCache"
+
+namespace hms {
+    void IndexCache::FillArchiveIdentity(const struct stat &sb, IndexCacheHeader *header) {
+        header->archive_inode = static_cast<uint64_t>(sb.st_ino);
+        header->archive_size = static_cast<uint64_t>(sb.st_size);
+        header->archive_mtime_sec = static_cast<int64_t>(sb.st_mtim.tv_sec);
+        header->archive_mtime_nsec = static_cast<int64_t>(sb.st_mtim.tv_nsec);
+    }
+
+    std::unique_ptr<IndexCache> IndexCache::Open(const char *path, const struct stat &sb) {
+        HLOGENTRY();
+        const int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC | O_BINARY));
+        if (fd < 0) {
+            HLOGD("Zip: no index cache at '%s': %s", path, strerror(errno));
+            return nullptr;
+        }
+
+        struct stat cache_sb;
+        if (fstat(fd, &cache_sb) == -1 ||
+            cache_sb.st_size < static_cast<off64_t>(sizeof(IndexCacheHeader))) {
+            HLOGW("Zip: index cache '%s' is truncated", path);
+            close(fd);
+            return nullptr;
+        }
+
+        std::unique_ptr<IndexCache> cache(new IndexCache());
+        const bool mapped = cache->map_.create(path, fd, 0, cache_sb.st_size, true /* read only */);
+        close(fd);
+        if (!mapped) {
+            return nullptr;
+        }
+
+        const IndexCacheHeader *header = cache->GetHeader();
+        IndexCacheHeader expected;
+        FillArchiveIdentity(sb, &expected);
+        if (header->magic != IndexCacheHeader::kMagic ||
+            header->version != IndexCacheHeader::kVersion ||
+            header->archive_inode != expected.archive_inode ||
+            header->archive_size != expected.archive_size ||
+            header->archive_mtime_sec != expected.archive_mtime_sec ||
+            header->archive_mtime_nsec != expected.archive_mtime_nsec) {
+            HLOGI("Zip: index cache '%s' is stale", path);
+            return nullptr;
+        }
+
+        if (static_cast<uint64_t>(cache_sb.st_size) !=
+            sizeof(IndexCacheHeader) +
+            EntryIndex::ByteSize(header->num_entries, header->hash_table_size)) {
+            HLOGW("Zip: index cache '%s' has a bad size %" PRId64, path,
+                  static_cast<int64_t>(cache_sb.st_size));
+            return nullptr;
+        }
+
+        return cache;
+    }
+
+    bool IndexCache::Write(const char *path, const IndexCacheHeader &header,
+                           const EntryIndex &index) {
+        HLOGENTRY();
+        // Write to a temporary file of our own and rename it over the old cache
+        // so that a concurrent reader never observes a partially written index,
+        // and concurrent writers never write into the same file.
+        std::string tmp_path;
+        const int fd = File::CreateTemp(path, &tmp_path);
+        if (fd < 0) {
+            HLOGW("Zip: unable to create index cache next to '%s': %s", path, strerror(errno));
+            return false;
+        }
+
+        const bool written = File::WriteFully(fd, &header, sizeof(header)) &&
+                             File::WriteFully(fd, index.GetData(), index.GetDataSize());
+        if (close(fd) != 0 || !written) {
+            HLOGW("Zip: unable to write index cache '%s': %s", tmp_path.c_str(), strerror(errno));
+            unlink(tmp_path.c_str());
+            return false;
+        }
+
+        if (rename(tmp_path.c_str(), path) != 0) {
+            HLOGW("Zip: unable to rename index cache to '%s': %s", path, strerror(errno));
+            unlink(tmp_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
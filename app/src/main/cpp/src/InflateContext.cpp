@@ -0,0 +1,117 @@
+//
+// Created by season on 2021/7/10.
+//
+
+#include <cstdlib>
+#include <cstring>
+
+#include <InflateContext.h>
+#include <HLog.h>
+
+#define LOG_TAG "InflateContext"
+
+namespace hms {
+    // This method is using libz macros with old-style-casts
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+
+    static inline int zlib_inflateInit2(z_stream *stream, int window_bits) {
+        return inflateInit2(stream, window_bits);
+    }
+
+#pragma GCC diagnostic pop
+
+    bool InflateContext::Init() {
+        void *buffers = nullptr;
+        if (posix_memalign(&buffers, kBufferAlignment, 2 * kBufferSize) != 0) {
+            HLOGW("Zip: unable to allocate inflate buffers");
+            return false;
+        }
+        buffers_ = static_cast<uint8_t *>(buffers);
+
+        /*
+         * Initialize the zlib stream struct.
+         */
+        memset(&stream_, 0, sizeof(stream_));
+        stream_.zalloc = Z_NULL;
+        stream_.zfree = Z_NULL;
+        stream_.opaque = Z_NULL;
+        stream_.next_in = NULL;
+        stream_.avail_in = 0;
+        stream_.data_type = Z_UNKNOWN;
+
+        /*
+         * Use the undocumented "negative window bits" feature to tell zlib
+         * that there's no zlib header waiting for it.
+         */
+        const int zerr = zlib_inflateInit2(&stream_, -MAX_WBITS);
+        if (zerr != Z_OK) {
+            if (zerr == Z_VERSION_ERROR) {
+                HLOGE("Installed zlib is not compatible with linked version (%s)", ZLIB_VERSION);
+            } else {
+                HLOGW("Call to inflateInit2 failed (zerr=%d)", zerr);
+            }
+            free(buffers_);
+            buffers_ = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    bool InflateContext::Reset() {
+        stream_.next_in = NULL;
+        stream_.avail_in = 0;
+        stream_.next_out = NULL;
+        stream_.avail_out = 0;
+        return inflateReset(&stream_) == Z_OK;
+    }
+
+    InflateContext::~InflateContext() {
+        if (buffers_ != nullptr) {
+            inflateEnd(&stream_); /* free up any allocated structures */
+            free(buffers_);
+        }
+    }
+
+    InflateContextPool::~InflateContextPool() {
+        for (InflateContext *context : free_) {
+            delete context;
+        }
+    }
+
+    bool InflateContextPool::Acquire(Handle *handle) {
+        InflateContext *context = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (!free_.empty()) {
+                context = free_.back();
+                free_.pop_back();
+            }
+        }
+
+        if (context == nullptr) {
+            std::unique_ptr<InflateContext> created(new InflateContext());
+            if (!created->Init()) {
+                return false;
+            }
+            context = created.release();
+        }
+
+        Releaser releaser;
+        releaser.pool = this;
+        *handle = Handle(context, releaser);
+        return true;
+    }
+
+    void InflateContextPool::Release(InflateContext *context) {
+        // Reset here rather than in Acquire, so a broken stream is dropped
+        // instead of being handed out again.
+        if (!context->Reset()) {
+            delete context;
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(lock_);
+        free_.push_back(context);
+    }
+}
@@ -0,0 +1,281 @@
+//
+// Created by season on 2021/7/13.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <IoUring.h>
+#include <HLog.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(IORING_OFF_SQ_RING) && defined(__NR_io_uring_setup)
+#define HMS_HAVE_IO_URING 1
+#endif
+
+#define LOG_TAG "IoUring"
+
+namespace hms {
+#if defined(HMS_HAVE_IO_URING)
+    // Set once a thread found io_uring unusable, so that other threads do
+    // not try again.
+    static std::atomic<bool> io_uring_unavailable(false);
+
+    IoUring *IoUring::ForThisThread() {
+        static thread_local std::unique_ptr<IoUring> ring;
+        static thread_local bool tried = false;
+        if (!tried && !io_uring_unavailable.load(std::memory_order_relaxed)) {
+            tried = true;
+            std::unique_ptr<IoUring> created(new IoUring());
+            if (created->Init()) {
+                ring = std::move(created);
+            } else {
+                io_uring_unavailable.store(true, std::memory_order_relaxed);
+            }
+        }
+        return ring.get();
+    }
+
+    IoUring::IoUring()
+            : ring_fd_(-1),
+              sq_ring_(MAP_FAILED),
+              sq_ring_size_(0),
+              cq_ring_(MAP_FAILED),
+              cq_ring_size_(0),
+              sqes_(MAP_FAILED),
+              sqes_size_(0),
+              sq_head_(nullptr),
+              sq_tail_(nullptr),
+              sq_mask_(0),
+              sq_entries_(0),
+              sq_array_(nullptr),
+              cq_head_(nullptr),
+              cq_tail_(nullptr),
+              cq_mask_(0),
+              cqes_(nullptr),
+              to_submit_(0),
+              next_token_(0),
+              buffers_(nullptr) {}
+
+    bool IoUring::Init() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, kQueueDepth, &params));
+        if (ring_fd_ < 0) {
+            HLOGI("+++ io_uring unavailable: %s", strerror(errno));
+            return false;
+        }
+
+        // Reads and writes without iovecs need Linux 5.6; ask rather than
+        // guess from the version.
+        const size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::unique_ptr<uint8_t[]> probe_buf(new uint8_t[probe_size]());
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(probe_buf.get());
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+            probe->last_op < IORING_OP_WRITE ||
+            (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) == 0 ||
+            (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) == 0) {
+            HLOGI("+++ io_uring lacks IORING_OP_READ/WRITE");
+            return false;
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            HLOGW("Zip: unable to map io_uring: %s", strerror(errno));
+            return false;
+        }
+        if (!single_mmap) {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                HLOGW("Zip: unable to map io_uring: %s", strerror(errno));
+                return false;
+            }
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) {
+            HLOGW("Zip: unable to map io_uring: %s", strerror(errno));
+            return false;
+        }
+
+        uint8_t *sq = static_cast<uint8_t *>(sq_ring_);
+        uint8_t *cq = static_cast<uint8_t *>(single_mmap ? sq_ring_ : cq_ring_);
+        sq_head_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+        cqes_ = cq + params.cq_off.cqes;
+
+        void *buffers = nullptr;
+        if (posix_memalign(&buffers, 4096, (kNumWriteBuffers + 1) * kBufferSize) != 0) {
+            HLOGW("Zip: unable to allocate io_uring buffers");
+            return false;
+        }
+        buffers_ = static_cast<uint8_t *>(buffers);
+        return true;
+    }
+
+    IoUring::~IoUring() {
+        // Closing the ring cancels whatever is still in flight.
+        if (sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED) {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (ring_fd_ >= 0) {
+            close(ring_fd_);
+        }
+        free(buffers_);
+    }
+
+    void *IoUring::GetSqe() {
+        const uint32_t tail = *sq_tail_;
+        if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_ && !Submit()) {
+            return nullptr;
+        }
+        io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes_) + (tail & sq_mask_);
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    uint64_t IoUring::Queue(void *sqe_ptr) {
+        io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqe_ptr);
+        sqe->user_data = ++next_token_;
+        const uint32_t tail = *sq_tail_;
+        sq_array_[tail & sq_mask_] = tail & sq_mask_;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+        return sqe->user_data;
+    }
+
+    uint64_t IoUring::PrepareRead(int fd, void *buf, size_t len, off64_t off) {
+        io_uring_sqe *sqe = static_cast<io_uring_sqe *>(GetSqe());
+        if (sqe == nullptr) {
+            return 0;
+        }
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uintptr_t>(buf);
+        sqe->len = static_cast<uint32_t>(len);
+        sqe->off = static_cast<uint64_t>(off);
+        return Queue(sqe);
+    }
+
+    uint64_t IoUring::PrepareWrite(int fd, const void *buf, size_t len, off64_t off) {
+        io_uring_sqe *sqe = static_cast<io_uring_sqe *>(GetSqe());
+        if (sqe == nullptr) {
+            return 0;
+        }
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uintptr_t>(buf);
+        sqe->len = static_cast<uint32_t>(len);
+        sqe->off = static_cast<uint64_t>(off);
+        return Queue(sqe);
+    }
+
+    bool IoUring::Enter(unsigned min_complete) {
+        const unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        for (;;) {
+            const long submitted = syscall(__NR_io_uring_enter, ring_fd_, to_submit_,
+                                           min_complete, flags, nullptr, 0);
+            if (submitted < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                HLOGW("Zip: io_uring_enter failed: %s", strerror(errno));
+                return false;
+            }
+            to_submit_ -= static_cast<uint32_t>(submitted);
+            return true;
+        }
+    }
+
+    bool IoUring::Submit() {
+        return to_submit_ == 0 || Enter(0);
+    }
+
+    void IoUring::Reap() {
+        uint32_t head = *cq_head_;
+        const uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe *cqe = static_cast<const io_uring_cqe *>(cqes_) + (head & cq_mask_);
+            Completion completion;
+            completion.token = cqe->user_data;
+            completion.result = cqe->res;
+            completed_.push_back(completion);
+            ++head;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    bool IoUring::Wait(uint64_t token, int32_t *result) {
+        for (;;) {
+            Reap();
+            for (size_t i = 0; i < completed_.size(); ++i) {
+                if (completed_[i].token == token) {
+                    *result = completed_[i].result;
+                    completed_[i] = completed_.back();
+                    completed_.pop_back();
+                    return true;
+                }
+            }
+            if (!Enter(1)) {
+                return false;
+            }
+        }
+    }
+#else
+    // Built against headers without io_uring: no ring is ever created.
+    IoUring *IoUring::ForThisThread() {
+        return nullptr;
+    }
+
+    IoUring::~IoUring() {}
+
+    uint64_t IoUring::PrepareRead(int, void *, size_t, off64_t) {
+        return 0;
+    }
+
+    uint64_t IoUring::PrepareWrite(int, const void *, size_t, off64_t) {
+        return 0;
+    }
+
+    bool IoUring::Submit() {
+        return false;
+    }
+
+    bool IoUring::Wait(uint64_t, int32_t *) {
+        return false;
+    }
+#endif  // HMS_HAVE_IO_URING
+}
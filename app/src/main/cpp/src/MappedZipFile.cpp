@@ -10,6 +10,7 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include <memory>
 #include <vector>
@@ -41,11 +42,13 @@ namespace hms {
 
     off64_t MappedZipFile::GetFileLength() const {
         if (has_fd_) {
-            off64_t result = lseek64(fd_, 0, SEEK_END);
-            if (result == -1) {
-                HLOGE("Zip: lseek on fd %d failed: %s", fd_, strerror(errno));
+            // fstat rather than lseek so that the shared file offset is left alone.
+            struct stat sb;
+            if (fstat(fd_, &sb) == -1) {
+                HLOGE("Zip: fstat on fd %d failed: %s", fd_, strerror(errno));
+                return -1;
             }
-            return result;
+            return static_cast<off64_t>(sb.st_size);
         } else {
             if (base_ptr_ == nullptr) {
                 HLOGE("Zip: invalid file map\n");
@@ -55,72 +58,104 @@ namespace hms {
         }
     }
 
-    bool MappedZipFile::SeekToOffset(off64_t offset) {
-        if (has_fd_) {
-            if (lseek64(fd_, offset, SEEK_SET) != offset) {
-                HLOGE("Zip: lseek to %" PRId64 " failed: %s\n", offset, strerror(errno));
-                return false;
+// Attempts to read |len| bytes into |buf| at offset |off|.
+    bool MappedZipFile::ReadAtOffset(uint8_t *buf, size_t len, off64_t off) const {
+        if (has_fd_ && archive_map_ == nullptr) {
+            while (len > 0) {
+                const ssize_t n = TEMP_FAILURE_RETRY(pread64(fd_, buf, len, off));
+                if (n <= 0) {
+                    HLOGE("Zip: failed to read at offset %"
+                                  PRId64
+                                  "\n", off);
+                    return false;
+                }
+                buf += n;
+                len -= n;
+                off += n;
             }
             return true;
-        } else {
-            if (offset < 0 || offset > static_cast<off64_t>(data_length_)) {
-                HLOGE("Zip: invalid offset: %"
-                              PRId64
-                              ", data length: %"
-                              PRId64
-                              "\n", offset, data_length_);
-                return false;
-            }
+        }
 
-            read_pos_ = offset;
-            return true;
+        const uint8_t *data = GetDataAt(off, len);
+        if (data == nullptr) {
+            HLOGE("Zip: invalid offset: %"
+                          PRId64
+                          ", length: %zu"
+                          "\n", off, len);
+            return false;
         }
+        memcpy(buf, data, len);
+        return true;
     }
 
-    bool MappedZipFile::ReadFully(void *data, size_t byte_count) {
+    bool MappedZipFile::MapArchive(const char *name) {
         if (!has_fd_) {
-            HLOGE("Invalid ZipFile fd");
+            // Already addressable.
+            return true;
+        }
+
+        const off64_t length = GetFileLength();
+        if (length <= 0 || static_cast<uint64_t>(length) > SIZE_MAX) {
             return false;
         }
-        uint8_t *p = reinterpret_cast<uint8_t *>(data);
-        size_t remaining = byte_count;
-        while (remaining > 0) {
-            ssize_t n = TEMP_FAILURE_RETRY(read(fd_, p, remaining));
-            if (n <= 0) return false;
-            p += n;
-            remaining -= n;
+
+        std::shared_ptr<FileMap> map(new FileMap());
+        if (!map->create(name, fd_, 0, static_cast<size_t>(length), true)) {
+            return false;
         }
+        // Extraction mostly walks the archive front to back.
+        map->advise(FileMap::SEQUENTIAL);
+        archive_map_ = map;
         return true;
     }
 
-    bool MappedZipFile::ReadData(uint8_t *buffer, size_t read_amount) {
-        if (has_fd_) {
-            if (!ReadFully(buffer, read_amount)) {
-                HLOGE("Zip: read from %d failed\n", fd_);
-                return false;
-            }
+    const uint8_t *MappedZipFile::GetDataAt(off64_t off, size_t len) const {
+        const uint8_t *base;
+        off64_t length;
+        if (!has_fd_) {
+            base = static_cast<const uint8_t *>(base_ptr_);
+            length = data_length_;
+        } else if (archive_map_ != nullptr) {
+            base = static_cast<const uint8_t *>(archive_map_->getDataPtr());
+            length = static_cast<off64_t>(archive_map_->getDataLength());
         } else {
-            memcpy(buffer, static_cast<uint8_t *>(base_ptr_) + read_pos_, read_amount);
-            read_pos_ += read_amount;
+            return nullptr;
         }
-        return true;
+
+        if (base == nullptr || off < 0 || static_cast<off64_t>(len) > length - off) {
+            return nullptr;
+        }
+        return base + off;
     }
 
-// Attempts to read |len| bytes into |buf| at offset |off|.
-    bool MappedZipFile::ReadAtOffset(uint8_t *buf, size_t len, off64_t off) {
-        if (has_fd_) {
-            if (static_cast<size_t>(TEMP_FAILURE_RETRY(pread64(fd_, buf, len, off))) != len) {
-                HLOGE("Zip: failed to read at offset %"
-                              PRId64
-                              "\n", off);
-                return false;
-            }
-            return true;
+    void MappedZipFile::WillNeed(off64_t off, size_t len) const {
+        if (archive_map_ != nullptr && off >= 0) {
+            archive_map_->advise(FileMap::WILLNEED, static_cast<size_t>(off), len);
         }
-        if (!SeekToOffset(off)) {
-            return false;
+    }
+
+    void MappedZipFile::WillReadOnce(off64_t off, size_t len) const {
+        if (!has_fd_ || off < 0) {
+            return;
+        }
+        if (archive_map_ != nullptr) {
+            archive_map_->advise(FileMap::WILLNEED, static_cast<size_t>(off), len);
+            return;
+        }
+        // Not POSIX_FADV_SEQUENTIAL: that widens readahead for the whole file,
+        // pulling back neighbours that were extracted, and dropped, before.
+        posix_fadvise(fd_, off, len, POSIX_FADV_WILLNEED);
+    }
+
+    void MappedZipFile::DontNeed(off64_t off, size_t len) const {
+        if (!has_fd_ || off < 0) {
+            return;
+        }
+        // The cache keeps pages that are still mapped, so unmap ours first.
+        if (archive_map_ != nullptr) {
+            archive_map_->advise(FileMap::DONTNEED, static_cast<size_t>(off), len);
         }
-        return ReadData(buf, len);
+        posix_fadvise(fd_, off, len, POSIX_FADV_DONTNEED);
     }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,362 @@
+//
+// Created by season on 2021/7/15.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include <File.h>
+#include <FileMap.h>
+#include <Crc32.h>
+#include <SeekIndex.h>
+#include <ZipFile.h>
+#include <HLog.h>
+
+#define LOG_TAG "SeekIndex"
+
+namespace hms {
+    namespace {
+        // Hands a range of compressed data to a zlib stream: all at once when
+        // the archive is addressable, in buffer-sized reads otherwise.
+        class InputFeeder {
+        public:
+            InputFeeder(const MappedZipFile *zip, uint8_t *buffer, off64_t offset,
+                        uint64_t length)
+                    : zip_(zip),
+                      mapped_(zip->GetDataAt(offset, length)),
+                      buffer_(buffer),
+                      offset_(offset),
+                      remaining_(length) {}
+
+            // Refill |zstream| if it has consumed its input. Returns "false"
+            // on a read error.
+            bool Feed(z_stream *zstream) {
+                if (zstream->avail_in != 0 || remaining_ == 0) {
+                    return true;
+                }
+                if (mapped_ != nullptr) {
+                    // zlib never writes through next_in; it is only const with ZLIB_CONST.
+                    zstream->next_in = const_cast<uint8_t *>(mapped_);
+                    zstream->avail_in = static_cast<uInt>(remaining_);
+                    remaining_ = 0;
+                    return true;
+                }
+                const size_t kBufSize = InflateContext::kBufferSize;
+                const size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining_, kBufSize));
+                if (!zip_->ReadAtOffset(buffer_, chunk, offset_)) {
+                    HLOGW("Zip: inflate read failed: %s", strerror(errno));
+                    return false;
+                }
+                offset_ += chunk;
+                remaining_ -= chunk;
+                zstream->next_in = buffer_;
+                zstream->avail_in = static_cast<uInt>(chunk);
+                return true;
+            }
+
+            uint64_t GetRemaining() const { return remaining_; }
+
+        private:
+            const MappedZipFile *const zip_;
+            const uint8_t *const mapped_;
+            uint8_t *const buffer_;
+            off64_t offset_;
+            uint64_t remaining_;
+        };
+    }
+
+    void SeekIndex::Clear() {
+        header_ = SeekIndexHeader();
+        checkpoints_.clear();
+        windows_.clear();
+    }
+
+    bool SeekIndex::Matches(const ZipEntry &entry) const {
+        return header_.magic == SeekIndexHeader::kMagic &&
+               header_.entry_offset == static_cast<uint64_t>(entry.offset) &&
+               header_.compressed_length == entry.compressed_length &&
+               header_.uncompressed_length == entry.uncompressed_length &&
+               header_.crc32 == entry.crc32;
+    }
+
+    void SeekIndex::AddCheckpoint(uint32_t bits, uint64_t in, uint64_t out,
+                                  const uint8_t *ring, size_t pos) {
+        const size_t kRingSize = InflateContext::kBufferSize;
+        const size_t kWindow = kWindowSize;
+        Checkpoint checkpoint;
+        checkpoint.out = out;
+        checkpoint.in = in;
+        checkpoint.bits = bits;
+        checkpoint.reserved = 0;
+        checkpoints_.push_back(checkpoint);
+
+        // The window is right-aligned; early checkpoints have less history.
+        windows_.resize(windows_.size() + kWindow);
+        uint8_t *const window = windows_.data() + windows_.size() - kWindow;
+        const size_t have = static_cast<size_t>(std::min<uint64_t>(out, kWindow));
+        const size_t tail = std::min(have, pos);
+        memset(window, 0, kWindow - have);
+        memcpy(window + kWindow - tail, ring + pos - tail, tail);
+        memcpy(window + kWindow - have, ring + kRingSize - (have - tail), have - tail);
+    }
+
+    int32_t SeekIndex::Build(const MappedZipFile *zip, const ZipEntry &entry,
+                             InflateContext *context, uint32_t spacing, bool check_crc) {
+        HLOGENTRY();
+        const size_t kBufSize = InflateContext::kBufferSize;
+        Clear();
+
+        z_stream &zstream = *context->GetStream();
+        uint8_t *const ring = context->GetWriteBuffer();
+        InputFeeder input(zip, context->GetReadBuffer(), entry.offset, entry.compressed_length);
+        zstream.next_out = ring;
+        zstream.avail_out = kBufSize;
+
+        // The write buffer is used as a ring, so the 32 KB before any point
+        // of the output are still in it when a block ends there.
+        static_assert(InflateContext::kBufferSize >= kWindowSize,
+                      "InflateContext buffers cannot hold a deflate window");
+        uint64_t last = 0;
+        uint32_t crc = 0;
+        int zerr;
+        do {
+            if (!input.Feed(&zstream)) {
+                return kIoError;
+            }
+            if (zstream.avail_out == 0) {
+                zstream.next_out = ring;
+                zstream.avail_out = kBufSize;
+            }
+
+            // Z_BLOCK returns at every block boundary.
+            uint8_t *const out_start = zstream.next_out;
+            zerr = inflate(&zstream, Z_BLOCK);
+            if (zerr != Z_OK && zerr != Z_STREAM_END) {
+                HLOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)", zerr,
+                      zstream.next_in, zstream.avail_in, zstream.next_out, zstream.avail_out);
+                return kZlibError;
+            }
+            if (check_crc) {
+                crc = Crc32::Update(crc, out_start, zstream.next_out - out_start);
+            }
+
+            // Bit 7 of data_type marks the end of a block, bit 6 the last
+            // block, after which there is nothing to resume.
+            if ((zstream.data_type & 128) != 0 && (zstream.data_type & 64) == 0 &&
+                zstream.total_out - last >= spacing) {
+                AddCheckpoint(static_cast<uint32_t>(zstream.data_type & 7), zstream.total_in,
+                              zstream.total_out, ring, zstream.next_out - ring);
+                last = zstream.total_out;
+            }
+        } while (zerr != Z_STREAM_END);
+
+        if (zstream.total_out != entry.uncompressed_length || input.GetRemaining() != 0) {
+            HLOGW("Zip: size mismatch on inflated file (%lu vs %" PRIu32 ")", zstream.total_out,
+                  entry.uncompressed_length);
+            return kInconsistentInformation;
+        }
+        if (check_crc && crc != entry.crc32) {
+            HLOGW("Zip: crc mismatch: expected %" PRIu32 ", was %" PRIu32, entry.crc32, crc);
+            return kInconsistentInformation;
+        }
+
+        SetEntry(entry, spacing);
+        return 0;
+    }
+
+    void SeekIndex::SetEntry(const ZipEntry &entry, uint32_t spacing) {
+        header_.magic = SeekIndexHeader::kMagic;
+        header_.version = SeekIndexHeader::kVersion;
+        header_.entry_offset = static_cast<uint64_t>(entry.offset);
+        header_.compressed_length = entry.compressed_length;
+        header_.uncompressed_length = entry.uncompressed_length;
+        header_.crc32 = entry.crc32;
+        header_.spacing = spacing;
+        header_.num_checkpoints = static_cast<uint32_t>(checkpoints_.size());
+    }
+
+    int64_t SeekIndex::Read(const MappedZipFile *zip, const ZipEntry &entry,
+                            InflateContext *context, uint64_t offset, uint8_t *out,
+                            size_t len) const {
+        HLOGENTRY();
+        const size_t kBufSize = InflateContext::kBufferSize;
+        const size_t kWindow = kWindowSize;
+        if (offset >= entry.uncompressed_length) {
+            return 0;
+        }
+        len = static_cast<size_t>(std::min<uint64_t>(len, entry.uncompressed_length - offset));
+
+        // The last checkpoint at or before |offset|, if any.
+        const Checkpoint *checkpoint = nullptr;
+        auto next = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), offset,
+                                     [](uint64_t value, const Checkpoint &c) {
+                                         return value < c.out;
+                                     });
+        if (next != checkpoints_.begin()) {
+            checkpoint = &*(next - 1);
+        }
+
+        z_stream &zstream = *context->GetStream();
+        uint64_t in = 0;
+        uint64_t out_pos = 0;
+        if (checkpoint != nullptr) {
+            in = checkpoint->in;
+            out_pos = checkpoint->out;
+            if (checkpoint->bits != 0) {
+                uint8_t byte;
+                if (!zip->ReadAtOffset(&byte, 1, entry.offset + in - 1)) {
+                    HLOGW("Zip: inflate read failed: %s", strerror(errno));
+                    return kIoError;
+                }
+                inflatePrime(&zstream, static_cast<int>(checkpoint->bits),
+                             byte >> (8 - checkpoint->bits));
+            }
+            const size_t have = static_cast<size_t>(std::min<uint64_t>(out_pos, kWindow));
+            const uint8_t *window = windows_.data() + (checkpoint - checkpoints_.data() + 1) *
+                                                      kWindow - have;
+            if (inflateSetDictionary(&zstream, window, static_cast<uInt>(have)) != Z_OK) {
+                HLOGW("Zip: unable to resume inflating at %" PRIu64, out_pos);
+                return kZlibError;
+            }
+        }
+
+        InputFeeder input(zip, context->GetReadBuffer(), entry.offset + in,
+                          entry.compressed_length - in);
+        size_t done = 0;
+        while (done < len) {
+            // Inflate what precedes |offset| into the write buffer, then the
+            // rest straight into |out|.
+            if (out_pos < offset) {
+                zstream.next_out = context->GetWriteBuffer();
+                zstream.avail_out = static_cast<uInt>(std::min<uint64_t>(offset - out_pos, kBufSize));
+            } else {
+                zstream.next_out = out + done;
+                zstream.avail_out = static_cast<uInt>(len - done);
+            }
+            const uInt avail_out = zstream.avail_out;
+            if (!input.Feed(&zstream)) {
+                return kIoError;
+            }
+            const int zerr = inflate(&zstream, Z_NO_FLUSH);
+            if (zerr != Z_OK && zerr != Z_STREAM_END) {
+                HLOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)", zerr,
+                      zstream.next_in, zstream.avail_in, zstream.next_out, zstream.avail_out);
+                return kZlibError;
+            }
+            const size_t produced = avail_out - zstream.avail_out;
+            if (out_pos < offset) {
+                out_pos += produced;
+            } else {
+                done += produced;
+            }
+            if (zerr == Z_STREAM_END && done < len) {
+                HLOGW("Zip: inflated data ends before its declared length %" PRIu32,
+                      entry.uncompressed_length);
+                return kInconsistentInformation;
+            }
+        }
+        return static_cast<int64_t>(done);
+    }
+
+    int32_t SeekIndex::WriteToFile(const char *path) const {
+        HLOGENTRY();
+        const size_t checkpoints_size = checkpoints_.size() * sizeof(Checkpoint);
+        SeekIndexHeader header = header_;
+        header.data_crc32 = Crc32::Update(
+                Crc32::Update(0, reinterpret_cast<const uint8_t *>(checkpoints_.data()),
+                              checkpoints_size),
+                windows_.data(), windows_.size());
+
+        // Write to a temporary file of our own and rename it over the old
+        // index so that a concurrent reader never observes a partially
+        // written one, and concurrent writers never mix theirs.
+        std::string tmp_path;
+        const int fd = File::CreateTemp(path, &tmp_path);
+        if (fd < 0) {
+            HLOGW("Zip: unable to create seek index next to '%s': %s", path, strerror(errno));
+            return kIoError;
+        }
+
+        const bool written =
+                File::WriteFully(fd, &header, sizeof(header)) &&
+                File::WriteFully(fd, checkpoints_.data(), checkpoints_size) &&
+                File::WriteFully(fd, windows_.data(), windows_.size());
+        if (close(fd) != 0 || !written) {
+            HLOGW("Zip: unable to write seek index '%s': %s", tmp_path.c_str(), strerror(errno));
+            unlink(tmp_path.c_str());
+            return kIoError;
+        }
+
+        if (rename(tmp_path.c_str(), path) != 0) {
+            HLOGW("Zip: unable to rename seek index to '%s': %s", path, strerror(errno));
+            unlink(tmp_path.c_str());
+            return kIoError;
+        }
+        return 0;
+    }
+
+    int32_t SeekIndex::ReadFromFile(const char *path) {
+        HLOGENTRY();
+        const int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC | O_BINARY));
+        if (fd < 0) {
+            HLOGD("Zip: no seek index at '%s': %s", path, strerror(errno));
+            return kIoError;
+        }
+
+        struct stat sb;
+        if (fstat(fd, &sb) == -1 || sb.st_size < static_cast<off64_t>(sizeof(SeekIndexHeader))) {
+            HLOGW("Zip: seek index '%s' is truncated", path);
+            close(fd);
+            return kInconsistentInformation;
+        }
+        FileMap map;
+        const bool mapped = map.create(path, fd, 0, sb.st_size, true /* read only */);
+        close(fd);
+        if (!mapped) {
+            return kIoError;
+        }
+
+        SeekIndexHeader header;
+        memcpy(&header, map.getDataPtr(), sizeof(header));
+        const uint64_t num = header.num_checkpoints;
+        if (header.magic != SeekIndexHeader::kMagic ||
+            header.version != SeekIndexHeader::kVersion ||
+            static_cast<uint64_t>(sb.st_size) !=
+            sizeof(header) + num * (sizeof(Checkpoint) + kWindowSize)) {
+            HLOGW("Zip: '%s' is not a valid seek index", path);
+            return kInconsistentInformation;
+        }
+
+        const uint8_t *data = static_cast<const uint8_t *>(map.getDataPtr()) + sizeof(header);
+        if (Crc32::Update(0, data, static_cast<size_t>(sb.st_size) - sizeof(header)) !=
+            header.data_crc32) {
+            HLOGW("Zip: seek index '%s' fails its checksum", path);
+            return kInconsistentInformation;
+        }
+
+        const Checkpoint *records = reinterpret_cast<const Checkpoint *>(data);
+        std::vector<Checkpoint> checkpoints(records, records + num);
+        data += checkpoints.size() * sizeof(Checkpoint);
+        for (size_t i = 0; i < checkpoints.size(); ++i) {
+            const Checkpoint &c = checkpoints[i];
+            if (c.bits > 7 || c.in > header.compressed_length ||
+                (c.bits != 0 && c.in == 0) || c.out > header.uncompressed_length ||
+                (i > 0 && c.out <= checkpoints[i - 1].out)) {
+                HLOGW("Zip: seek index '%s' has a bad checkpoint %zu", path, i);
+                return kInconsistentInformation;
+            }
+        }
+
+        header_ = header;
+        checkpoints_.swap(checkpoints);
+        windows_.assign(data, data + checkpoints_.size() * kWindowSize);
+        return 0;
+    }
+}
@@ -0,0 +1,71 @@
+//
+// Created by season on 2021/7/8.
+//
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <WorkStealingPool.h>
+#include <HLog.h>
+
+#define LOG_TAG "WorkStealingPool"
+
+namespace hms {
+    WorkStealingPool::WorkStealingPool(size_t num_threads) : num_threads_(num_threads) {
+        if (num_threads_ == 0) {
+            const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            num_threads_ = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+        }
+        queues_.reset(new Queue[num_threads_]);
+    }
+
+    bool WorkStealingPool::Pop(size_t queue, size_t *task) {
+        std::lock_guard<std::mutex> guard(queues_[queue].lock);
+        std::deque<size_t> &tasks = queues_[queue].tasks;
+        if (tasks.empty()) {
+            return false;
+        }
+        *task = tasks.front();
+        tasks.pop_front();
+        return true;
+    }
+
+    void WorkStealingPool::Work(size_t self, const Task &task) {
+        size_t next;
+        for (;;) {
+            if (!Pop(self, &next)) {
+                // Nothing is ever queued once the batch has started, so a
+                // thread that finds every queue empty is done.
+                bool stolen = false;
+                for (size_t i = 1; i < num_threads_ && !stolen; ++i) {
+                    stolen = Pop((self + i) % num_threads_, &next);
+                }
+                if (!stolen) {
+                    return;
+                }
+            }
+            task(next);
+        }
+    }
+
+    void WorkStealingPool::Run(size_t num_tasks, const Task &task) {
+        HLOGENTRY();
+        for (size_t i = 0; i < num_tasks; ++i) {
+            queues_[i % num_threads_].tasks.push_back(i);
+        }
+
+        const size_t num_workers = std::min(num_threads_, num_tasks);
+        std::vector<std::thread> workers;
+        workers.reserve(num_workers);
+        for (size_t i = 1; i < num_workers; ++i) {
+            workers.emplace_back(&WorkStealingPool::Work, this, i, std::cref(task));
+        }
+        Work(0, task);
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        HLOGV("+++ ran %zu tasks on %zu threads", num_tasks, num_workers);
+    }
+}
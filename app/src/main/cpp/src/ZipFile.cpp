@@ -12,7 +12,16 @@
 #include <ctime>
 #include <unistd.h>
 
+#include <sys/stat.h>
+#include <sys/xattr.h>
+
+#include <algorithm>
 #include <memory>
+#include <new>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <File.h>
@@ -27,61 +36,21 @@
 #include <ZipFile.h>
 #include <IterationHandle.h>
 #include <FileWriter.h>
+#include <MappedFileWriter.h>
+#include <DirectFileWriter.h>
+#include <DiscardWriter.h>
+#include <MemoryWriter.h>
+#include <BufferWriter.h>
+#include <UringFileWriter.h>
+#include <ChunkReader.h>
+#include <SpscQueue.h>
+#include <IndexCache.h>
+#include <Crc32.h>
+#include <WorkStealingPool.h>
 #include <HLog.h>
 #define LOG_TAG "ZipFile"
 
 namespace hms {
-    /*
- * Round up to the next highest power of 2.
- *
- * Found on http://graphics.stanford.edu/~seander/bithacks.html.
- */
-    uint32_t ZipFile::RoundUpPower2(uint32_t val) {
-        val--;
-        val |= val >> 1;
-        val |= val >> 2;
-        val |= val >> 4;
-        val |= val >> 8;
-        val |= val >> 16;
-        val++;
-
-        return val;
-    }
-
-    uint32_t ZipFile::ComputeHash(const ZipString &name) {
-        uint32_t hash = 0;
-        uint16_t len = name.name_length;
-        const uint8_t *str = name.name;
-
-        while (len--) {
-            hash = hash * 31 + *str++;
-        }
-
-        return hash;
-    }
-
-    int32_t ZipFile::AddToHash(const ZipString &name) {
-        const uint64_t hash = ComputeHash(name);
-        uint32_t ent = hash & (hash_table_size - 1);
-
-        /*
-         * We over-allocated the table, so we're guaranteed to find an empty slot.
-         * Further, we guarantee that the hashtable size is not 0.
-         */
-        while (hash_table[ent].name != NULL) {
-            if (hash_table[ent] == name) {
-                // We've found a duplicate entry. We don't accept it
-                HLOGW("Zip: Found duplicate entry %.*s", name.name_length, name.name);
-                return kDuplicateEntry;
-            }
-            ent = (ent + 1) & (hash_table_size - 1);
-        }
-
-        hash_table[ent].name = name.name;
-        hash_table[ent].name_length = name.name_length;
-        return 0;
-    }
-
     int32_t ZipFile::MapCentralDirectory0(off64_t file_length, off64_t read_amount,
                                           uint8_t *scan_buffer) {
         const off64_t search_start = file_length - read_amount;
@@ -232,16 +201,10 @@ namespace hms {
 //        const uint16_t num_entries = num_entries;
 
         /*
-         * Create hash table.  We have a minimum 75% load factor, possibly as
-         * low as 50% after we round off to a power of 2.  There must be at
-         * least one unused entry to avoid an infinite loop during creation.
+         * Create the entry index. It is sized from |num_entries| up front and
+         * never grows.
          */
-        hash_table_size = RoundUpPower2(1 + (num_entries * 4) / 3);
-        hash_table =
-                reinterpret_cast<ZipString *>(calloc(hash_table_size, sizeof(ZipString)));
-        if (hash_table == nullptr) {
-            HLOGW("Zip: unable to allocate the %u-entry hash_table, entry size: %zu",
-                  hash_table_size, sizeof(ZipString));
+        if (!entry_index.Allocate(cd_ptr, num_entries)) {
             return -1;
         }
 
@@ -296,14 +259,11 @@ namespace hms {
                 return -1;
             }
 
-            /* add the CDE filename to the hash table */
-            ZipString entry_name;
-            entry_name.name = file_name;
-            entry_name.name_length = file_name_length;
-            const int add_result = AddToHash(entry_name);
-            if (add_result != 0) {
-                HLOGW("Zip: Error adding entry to hash table %d", add_result);
-                return add_result;
+            /* add the CDE to the entry index */
+            if (!entry_index.Add(cdr)) {
+                // We've found a duplicate entry. We don't accept it
+                HLOGW("Zip: Found duplicate entry %.*s", file_name_length, file_name);
+                return kDuplicateEntry;
             }
 
             ptr += sizeof(CentralDirectoryRecord) + file_name_length + extra_length +
@@ -335,6 +295,13 @@ namespace hms {
         return 0;
     }
 
+    void ZipFile::ResetResolvedOffsets() {
+        resolved_offsets.reset(new std::atomic<uint64_t>[num_entries]);
+        for (uint32_t i = 0; i < num_entries; ++i) {
+            resolved_offsets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
     int32_t ZipFile::OpenArchiveInternal() {
         int32_t result = -1;
         if ((result = MapCentralDirectory()) != 0) {
@@ -345,10 +312,90 @@ namespace hms {
             return result;
         }
 
+        ResetResolvedOffsets();
         return 0;
     }
 
+    uint32_t ZipFile::ComputeCentralDirectoryCrc() {
+        return Crc32::Update(0, central_directory.GetBasePtr(), central_directory.GetMapLength());
+    }
+
+    int32_t ZipFile::LoadIndexCache(const char *path, const struct stat &sb) {
+        HLOGENTRY();
+        std::unique_ptr<IndexCache> cache = IndexCache::Open(path, sb);
+        if (cache == nullptr) {
+            return kInvalidFile;
+        }
+
+        const IndexCacheHeader *header = cache->GetHeader();
+        if (header->num_entries == 0 ||
+            header->cd_size < header->num_entries * sizeof(CentralDirectoryRecord) ||
+            static_cast<uint64_t>(header->cd_start_offset) + header->cd_size > header->archive_size) {
+            HLOGW("Zip: index cache '%s' has a bad central directory", path);
+            return kInvalidFile;
+        }
+
+        if (!InitializeCentralDirectory(static_cast<off64_t>(header->cd_start_offset),
+                                        static_cast<size_t>(header->cd_size))) {
+            directory_map.reset(new hms::FileMap());
+            return kMmapFailed;
+        }
+
+        if (ComputeCentralDirectoryCrc() != header->cd_crc32) {
+            HLOGI("Zip: index cache '%s' does not match the central directory", path);
+            directory_map.reset(new hms::FileMap());
+            return kInconsistentInformation;
+        }
+
+        // The index only stores offsets into the central directory, which we
+        // just verified, so once the block itself checks out it is used in
+        // place.
+        if (Crc32::Update(0, static_cast<const uint8_t *>(cache->GetIndexData()),
+                          cache->GetIndexDataSize()) != header->index_crc32) {
+            HLOGW("Zip: index cache '%s' fails its checksum", path);
+            directory_map.reset(new hms::FileMap());
+            return kInvalidFile;
+        }
+        if (!entry_index.Attach(central_directory.GetBasePtr(), central_directory.GetMapLength(),
+                                cache->GetIndexData(), cache->GetIndexDataSize(),
+                                header->num_entries, header->hash_table_size)) {
+            HLOGW("Zip: index cache '%s' is corrupt", path);
+            directory_map.reset(new hms::FileMap());
+            return kInvalidFile;
+        }
+
+        num_entries = header->num_entries;
+        directory_offset = header->cd_start_offset;
+        index_cache = std::move(cache);
+        ResetResolvedOffsets();
+        return 0;
+    }
+
+    void ZipFile::WriteIndexCache(const char *path, const struct stat &sb) {
+        HLOGENTRY();
+        IndexCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = IndexCacheHeader::kMagic;
+        header.version = IndexCacheHeader::kVersion;
+        IndexCache::FillArchiveIdentity(sb, &header);
+        header.cd_start_offset = static_cast<uint32_t>(directory_offset);
+        header.cd_size = static_cast<uint32_t>(central_directory.GetMapLength());
+        header.cd_crc32 = ComputeCentralDirectoryCrc();
+        header.num_entries = num_entries;
+        header.hash_table_size = entry_index.GetTableSize();
+        header.index_crc32 = Crc32::Update(0, static_cast<const uint8_t *>(entry_index.GetData()),
+                                           entry_index.GetDataSize());
+
+        if (!IndexCache::Write(path, header, entry_index)) {
+            HLOGW("Zip: unable to update index cache '%s'", path);
+        }
+    }
+
     int32_t ZipFile::OpenArchive() {
+        return OpenArchive(OpenOptions());
+    }
+
+    int32_t ZipFile::OpenArchive(const OpenOptions &options) {
         HLOGENTRY();
         const int fd = open(mArchiveName, O_RDONLY | O_BINARY, 0);
         if (fd < 0) {
@@ -356,12 +403,50 @@ namespace hms {
             return kIoError;
         }
         mapped_zip = std::unique_ptr<hms::MappedZipFile>(new MappedZipFile(fd));
-        return OpenArchiveInternal();
+        verify_crc = options.verify_crc;
+        decompressor = options.decompressor;
+        use_io_uring = options.io_uring;
+        pipeline_threshold = options.pipeline_threshold;
+        if (options.map_archive && !mapped_zip->MapArchive(mArchiveName)) {
+            HLOGW("Zip: unable to map '%s', reading it instead", mArchiveName);
+        }
+        const int32_t result = OpenArchiveInternal(options);
+        if (result == 0 && options.build_sorted_index) {
+            BuildSortedIndex();
+        }
+        return result;
+    }
+
+    int32_t ZipFile::OpenArchiveInternal(const OpenOptions &options) {
+        if (options.index_cache_path == nullptr) {
+            return OpenArchiveInternal();
+        }
+
+        const int fd = mapped_zip->GetFileDescriptor();
+
+        struct stat sb;
+        if (fstat(fd, &sb) == -1) {
+            HLOGW("Zip: unable to fstat '%s': %s", mArchiveName, strerror(errno));
+            return kIoError;
+        }
+
+        if (LoadIndexCache(options.index_cache_path, sb) == 0) {
+            HLOGV("+++ opened %s from index cache", mArchiveName);
+            return 0;
+        }
+
+        const int32_t result = OpenArchiveInternal();
+        if (result == 0) {
+            WriteIndexCache(options.index_cache_path, sb);
+        }
+        return result;
     }
 
     int32_t ZipFile::ValidateDataDescriptor(ZipEntry *entry) {
+        // The data descriptor immediately follows the compressed data.
+        const off64_t dd_offset = entry->offset + entry->compressed_length;
         uint8_t ddBuf[sizeof(DataDescriptor) + sizeof(DataDescriptor::kOptSignature)];
-        if (!mapped_zip->ReadData(ddBuf, sizeof(ddBuf))) {
+        if (!mapped_zip->ReadAtOffset(ddBuf, sizeof(ddBuf), dd_offset)) {
             return kIoError;
         }
 
@@ -395,52 +480,72 @@ namespace hms {
         return 0;
     }
 
-    int32_t
-    ZipFile::FindEntry(const int ent, ZipEntry *data) {
-        const uint16_t nameLen = hash_table[ent].name_length;
+    void ZipFile::FillEntryFromIndex(const uint32_t ent, ZipEntry *data) {
+        const CentralDirectoryRecord *cdr = entry_index.GetRecord(ent);
 
-        // Recover the start of the central directory entry from the filename
-        // pointer.  The filename is the first entry past the fixed-size data,
-        // so we can just subtract back from that.
-        const uint8_t *ptr = hash_table[ent].name;
-        ptr -= sizeof(CentralDirectoryRecord);
+        // Fill out the compression method, modification time, crc32
+        // and other interesting attributes from the entry index. These
+        // will later be compared against values from the local file header.
+        data->index = ent;
+        data->method = entry_index.GetMethod(ent);
+        data->mod_time = cdr->last_mod_date << 16 | cdr->last_mod_time;
+        data->crc32 = entry_index.GetCrc32(ent);
+        data->compressed_length = entry_index.GetCompressedLength(ent);
+        data->uncompressed_length = entry_index.GetUncompressedLength(ent);
 
-        // This is the base of our mmapped region, we have to sanity check that
-        // the name that's in the hash table is a pointer to a location within
-        // this mapped region.
-        const uint8_t *base_ptr = central_directory.GetBasePtr();
-        if (ptr < base_ptr || ptr > base_ptr + central_directory.GetMapLength()) {
-            HLOGW("Zip: Invalid entry pointer");
-            return kInvalidOffset;
+        // 4.4.2.1: the upper byte of `version_made_by` gives the source OS. Unix is 3.
+        if ((cdr->version_made_by >> 8) == 3) {
+            data->unix_mode = (cdr->external_file_attributes >> 16) & 0xffff;
+        } else {
+            data->unix_mode = 0777;
         }
 
-        const CentralDirectoryRecord *cdr = reinterpret_cast<const CentralDirectoryRecord *>(ptr);
+        // Until the local file header has been validated, the central
+        // directory is all we know about the data descriptor.
+        const uint64_t resolved = resolved_offsets[ent].load(std::memory_order_relaxed);
+        if (resolved != 0) {
+            data->offset = static_cast<off64_t>(resolved & kResolvedOffsetMask);
+            data->has_data_descriptor = (resolved & kResolvedDataDescriptor) != 0;
+        } else {
+            data->offset = 0;
+            data->has_data_descriptor = (cdr->gpb_flags & kGPBDDFlagMask) != 0;
+        }
+    }
 
-        // The offset of the start of the central directory in the zipfile.
-        // We keep this lying around so that we can sanity check all our lengths
-        // and our per-file structures.
-        const off64_t cd_offset = directory_offset;
+    int32_t ZipFile::ValidateLocalFileHeader(ZipEntry *data) {
+        const uint32_t ent = data->index;
+        if (ent >= num_entries) {
+            HLOGW("Zip: Invalid entry index %" PRIu32, ent);
+            return kInvalidHandle;
+        }
 
-        // Fill out the compression method, modification time, crc32
-        // and other interesting attributes from the central directory. These
-        // will later be compared against values from the local file header.
-        data->method = cdr->compression_method;
-        data->mod_time = cdr->last_mod_date << 16 | cdr->last_mod_time;
-        data->crc32 = cdr->crc32;
-        data->compressed_length = cdr->compressed_size;
-        data->uncompressed_length = cdr->uncompressed_size;
+        const ZipString entry_name = entry_index.GetName(ent);
+        const uint16_t nameLen = entry_name.name_length;
+        const CentralDirectoryRecord *cdr = entry_index.GetRecord(ent);
 
         // Figure out the local header offset from the central directory. The
         // actual file data will begin after the local header and the name /
         // extra comments.
-        const off64_t local_header_offset = cdr->local_file_header_offset;
+        const off64_t local_header_offset = entry_index.GetLocalHeaderOffset(ent);
         if (local_header_offset + static_cast<off64_t>(sizeof(LocalFileHeader)) >= directory_offset) {
             HLOGW("Zip: bad local hdr offset in zip");
             return kInvalidOffset;
         }
 
-        uint8_t lfh_buf[sizeof(LocalFileHeader)];
-        if (!mapped_zip->ReadAtOffset(lfh_buf, sizeof(lfh_buf), local_header_offset)) {
+        // Read the header and the name it should be followed by in one go; if
+        // the names do not even have the same length we find out below.
+        off64_t read_length = sizeof(LocalFileHeader) + nameLen;
+        if (local_header_offset + read_length > directory_offset) {
+            read_length = sizeof(LocalFileHeader);
+        }
+        uint8_t stack_buf[sizeof(LocalFileHeader) + 256];
+        std::vector<uint8_t> heap_buf;
+        uint8_t *lfh_buf = stack_buf;
+        if (read_length > static_cast<off64_t>(sizeof(stack_buf))) {
+            heap_buf.resize(read_length);
+            lfh_buf = heap_buf.data();
+        }
+        if (!mapped_zip->ReadAtOffset(lfh_buf, read_length, local_header_offset)) {
             HLOGW("Zip: failed reading lfh name from offset %"
                           PRId64,
                   static_cast<int64_t>(local_header_offset));
@@ -509,13 +614,6 @@ namespace hms {
             data->has_data_descriptor = 1;
         }
 
-        // 4.4.2.1: the upper byte of `version_made_by` gives the source OS. Unix is 3.
-        if ((cdr->version_made_by >> 8) == 3) {
-            data->unix_mode = (cdr->external_file_attributes >> 16) & 0xffff;
-        } else {
-            data->unix_mode = 0777;
-        }
-
         // Check that the local file header name matches the declared
         // name in the central directory.
         if (lfh->file_name_length == nameLen) {
@@ -525,14 +623,7 @@ namespace hms {
                 return kInvalidOffset;
             }
 
-            std::vector<uint8_t> name_buf(nameLen);
-            if (!mapped_zip->ReadAtOffset(name_buf.data(), nameLen, name_offset)) {
-                HLOGW("Zip: failed reading lfh name from offset %"
-                              PRId64, static_cast<int64_t>(name_offset));
-                return kIoError;
-            }
-
-            if (memcmp(hash_table[ent].name, name_buf.data(), nameLen)) {
+            if (memcmp(entry_name.name, lfh_buf + sizeof(LocalFileHeader), nameLen)) {
                 return kInconsistentInformation;
             }
 
@@ -578,132 +669,353 @@ namespace hms {
         }
 
         data->offset = data_offset;
+        // Racing validations of the same entry store the same value.
+        resolved_offsets[ent].store(static_cast<uint64_t>(data_offset) |
+                                    (data->has_data_descriptor ? kResolvedDataDescriptor : 0),
+                                    std::memory_order_relaxed);
         return 0;
     }
 
+    int32_t ZipFile::FindEntry(const int ent, ZipEntry *data) {
+        FillEntryFromIndex(ent, data);
+        if (data->offset != 0) {
+            // The local file header has already been validated.
+            return 0;
+        }
+
+        return ValidateLocalFileHeader(data);
+    }
 
-    int32_t ZipFile::StartIteration(const ZipString *optional_prefix,
-                                    const ZipString *optional_suffix) {
+    int32_t ZipFile::FindEntry(const ZipString &name, ZipEntry *data) {
         HLOGENTRY();
-        if (hash_table == nullptr) {
+        if (!entry_index.IsValid()) {
             HLOGW("Zip: Invalid ZipFileHandle");
             return kInvalidHandle;
         }
 
-        mCookie = std::unique_ptr<IterationHandle>(new IterationHandle(optional_prefix, optional_suffix));
-        mCookie->position = 0;
-//        mCookie->archive = this;
-        return 0;
+        if (name.name_length == 0) {
+            HLOGW("Zip: Invalid filename %.*s", name.name_length, name.name);
+            return kInvalidEntryName;
+        }
+
+        const int32_t ent = entry_index.Find(name);
+        if (ent < 0) {
+            HLOGV("Zip: Unable to find entry %.*s", name.name_length, name.name);
+            return kEntryNotFound;
+        }
+
+        return FindEntry(ent, data);
+    }
+
+    int32_t ZipFile::FindEntryByIndex(uint32_t index, ZipEntry *data) {
+        HLOGENTRY();
+        if (!entry_index.IsValid()) {
+            HLOGW("Zip: Invalid ZipFileHandle");
+            return kInvalidHandle;
+        }
+
+        if (index >= num_entries) {
+            HLOGV("Zip: No entry at index %u", index);
+            return kEntryNotFound;
+        }
+
+        return FindEntry(static_cast<int>(index), data);
     }
 
+    void ZipFile::BuildSortedIndex() {
+        std::call_once(sorted_entries_once, [this]() {
+            HLOGTENTRY(LOG_TAG);
+            sorted_entries.resize(num_entries);
+            for (uint32_t i = 0; i < num_entries; ++i) {
+                sorted_entries[i] = static_cast<uint16_t>(i);
+            }
+            const EntryIndex &index = entry_index;
+            std::sort(sorted_entries.begin(), sorted_entries.end(),
+                      [&index](uint16_t lhs, uint16_t rhs) {
+                          return index.GetName(lhs) < index.GetName(rhs);
+                      });
+        });
+    }
 
-    int32_t ZipFile::Next(ZipEntry *data, ZipString *name) {
-        if (mCookie == NULL) {
+    void ZipFile::BuildDirectoryTree() {
+        BuildSortedIndex();
+        std::call_once(directory_tree_once, [this]() {
+            directory_tree.Build(entry_index, sorted_entries);
+        });
+    }
+
+    int32_t ZipFile::ListDirectory(const ZipString &path, std::vector<ZipDirEntry> *children) {
+        if (!entry_index.IsValid()) {
+            HLOGW("Zip: Invalid ZipFileHandle");
             return kInvalidHandle;
         }
 
-        if (hash_table == NULL) {
+        BuildDirectoryTree();
+        const int32_t node = directory_tree.Lookup(path);
+        if (node < 0) {
+            return kEntryNotFound;
+        }
+        if (!directory_tree.IsDirectory(node)) {
+            return kNotADirectory;
+        }
+
+        directory_tree.ListChildren(node, children);
+        return 0;
+    }
+
+    int32_t ZipFile::Stat(const ZipString &path, ZipDirEntry *out) {
+        if (!entry_index.IsValid()) {
+            HLOGW("Zip: Invalid ZipFileHandle");
+            return kInvalidHandle;
+        }
+
+        BuildDirectoryTree();
+        const int32_t node = directory_tree.Lookup(path);
+        if (node < 0) {
+            return kEntryNotFound;
+        }
+
+        directory_tree.GetDirEntry(node, out);
+        return 0;
+    }
+
+    int32_t ZipFile::StartIteration(std::unique_ptr<IterationHandle> *cookie,
+                                    const ZipString *optional_prefix,
+                                    const ZipString *optional_suffix,
+                                    bool metadata_only) {
+        HLOGENTRY();
+        if (!entry_index.IsValid()) {
             HLOGW("Zip: Invalid ZipFileHandle");
             return kInvalidHandle;
         }
 
-        const uint32_t currentOffset = mCookie->position;
+        std::unique_ptr<IterationHandle> handle(new IterationHandle(optional_prefix, optional_suffix));
+        handle->metadata_only = metadata_only;
+        handle->begin = 0;
+        handle->end = num_entries;
+        if (handle->prefix.name_length != 0) {
+            // Names sharing a prefix are contiguous in name order.
+            BuildSortedIndex();
+            const EntryIndex &index = entry_index;
+            const ZipString &prefix = handle->prefix;
+            const auto first = std::lower_bound(
+                    sorted_entries.begin(), sorted_entries.end(), prefix,
+                    [&index](uint16_t ent, const ZipString &value) {
+                        return index.GetName(ent) < value;
+                    });
+            const auto last = std::partition_point(
+                    first, sorted_entries.end(),
+                    [&index, &prefix](uint16_t ent) {
+                        return index.GetName(ent).StartsWith(prefix);
+                    });
+            handle->sorted = true;
+            handle->begin = static_cast<uint32_t>(first - sorted_entries.begin());
+            handle->end = static_cast<uint32_t>(last - sorted_entries.begin());
+        }
+        handle->position = handle->begin;
+        *cookie = std::move(handle);
+        return 0;
+    }
+
 
-        for (uint32_t i = currentOffset; i < hash_table_size; ++i) {
-            if (hash_table[i].name != NULL &&
-                (mCookie->prefix.name_length == 0 || hash_table[i].StartsWith(mCookie->prefix)) &&
-                (mCookie->suffix.name_length == 0 || hash_table[i].EndsWith(mCookie->suffix))) {
-                mCookie->position = (i + 1);
-                const int error = FindEntry(i, data);
+    int32_t ZipFile::Next(IterationHandle *cookie, ZipEntry *data, ZipString *name) {
+        if (cookie == NULL) {
+            return kInvalidHandle;
+        }
+
+        if (!entry_index.IsValid()) {
+            HLOGW("Zip: Invalid ZipFileHandle");
+            return kInvalidHandle;
+        }
+
+        const uint32_t currentOffset = cookie->position;
+
+        for (uint32_t i = currentOffset; i < cookie->end; ++i) {
+            const uint32_t ent = cookie->sorted ? sorted_entries[i] : i;
+            const ZipString entry_name = entry_index.GetName(ent);
+            if ((cookie->sorted || cookie->prefix.name_length == 0 ||
+                 entry_name.StartsWith(cookie->prefix)) &&
+                (cookie->suffix.name_length == 0 || entry_name.EndsWith(cookie->suffix))) {
+                cookie->position = (i + 1);
+                int error = 0;
+                if (cookie->metadata_only) {
+                    FillEntryFromIndex(ent, data);
+                } else {
+                    error = FindEntry(ent, data);
+                }
                 if (!error) {
-                    name->name = hash_table[i].name;
-                    name->name_length = hash_table[i].name_length;
+                    *name = entry_name;
                 }
 
                 return error;
             }
         }
 
-        mCookie->position = 0;
+        cookie->position = cookie->begin;
         return kIterationEnd;
     }
 
-    // This method is using libz macros with old-style-casts
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wold-style-cast"
+    int32_t ZipFile::DecompressEntryToWriter(const ZipEntry *entry, Writer *writer,
+                                             Decompressor *decompressor, InflateContext *context,
+                                             uint8_t *heap_input, uint8_t *heap_output,
+                                             bool check_crc, uint64_t *crc_out) {
+        const size_t kBufSize = InflateContext::kBufferSize;
+        const uint32_t compressed_length = entry->compressed_length;
+        const uint32_t uncompressed_length = entry->uncompressed_length;
 
-    static inline int zlib_inflateInit2(z_stream *stream, int window_bits) {
-        return inflateInit2(stream, window_bits);
-    }
+        const uint8_t *input = mapped_zip->GetDataAt(entry->offset, compressed_length);
+        if (input != nullptr) {
+            if (compressed_length > kBufSize) {
+                mapped_zip->WillNeed(entry->offset, compressed_length);
+            }
+        } else {
+            uint8_t *read_buf = context->GetReadBuffer();
+            if (compressed_length > kBufSize) {
+                read_buf = heap_input;
+            }
+            if (!mapped_zip->ReadAtOffset(read_buf, compressed_length, entry->offset)) {
+                HLOGW("Zip: inflate read failed, size = %" PRIu32 ": %s", compressed_length,
+                      strerror(errno));
+                return kIoError;
+            }
+            input = read_buf;
+        }
 
-#pragma GCC diagnostic pop
+        uint8_t *output = writer->GetDirectBuffer();
+        if (output == nullptr) {
+            output = context->GetWriteBuffer();
+            if (uncompressed_length > kBufSize) {
+                output = heap_output;
+            }
+        }
 
-    int32_t ZipFile::InflateEntryToWriter(const ZipEntry *entry,
-                                          Writer *writer, uint64_t *crc_out) {
-        HLOGENTRY();
-        const size_t kBufSize = 32768;
-        std::vector<uint8_t> read_buf(kBufSize);
-        std::vector<uint8_t> write_buf(kBufSize);
-        z_stream zstream;
-        int zerr;
+        switch (decompressor->Decompress(context, input, compressed_length,
+                                         output, uncompressed_length)) {
+            case Decompressor::kSuccess:
+                break;
+            case Decompressor::kSizeMismatch:
+                HLOGW("Zip: size mismatch on inflated file (declared %" PRIu32 ")",
+                      uncompressed_length);
+                return kInconsistentInformation;
+            default:
+                return kZlibError;
+        }
 
-        /*
-         * Initialize the zlib stream struct.
-         */
-        memset(&zstream, 0, sizeof(zstream));
-        zstream.zalloc = Z_NULL;
-        zstream.zfree = Z_NULL;
-        zstream.opaque = Z_NULL;
-        zstream.next_in = NULL;
-        zstream.avail_in = 0;
-        zstream.next_out = &write_buf[0];
-        zstream.avail_out = kBufSize;
-        zstream.data_type = Z_UNKNOWN;
+        if (output != writer->GetDirectBuffer() && !writer->Append(output, uncompressed_length)) {
+            return kIoError;
+        }
+        *crc_out = check_crc ? Crc32::Update(0, output, uncompressed_length) : 0;
+        return 0;
+    }
 
-        /*
-         * Use the undocumented "negative window bits" feature to tell zlib
-         * that there's no zlib header waiting for it.
-         */
-        zerr = zlib_inflateInit2(&zstream, -MAX_WBITS);
-        if (zerr != Z_OK) {
-            if (zerr == Z_VERSION_ERROR) {
-                HLOGE("Installed zlib is not compatible with linked version (%s)", ZLIB_VERSION);
-            } else {
-                HLOGW("Call to inflateInit2 failed (zerr=%d)", zerr);
-            }
+    // Heap bytes whole-buffer decoding may stage for one entry before it is
+    // streamed through zlib instead.
+    static const size_t kMaxStagedLength = 32 * 1024 * 1024;
+
+    // ChunkReader reads into InflateContext buffers.
+    static_assert(IoUring::kBufferSize == InflateContext::kBufferSize,
+                  "IoUring and InflateContext buffers differ in size");
 
+    int32_t ZipFile::InflateEntryToWriter(const ZipEntry *entry, Writer *writer,
+                                          DecompressorType decompressor, bool check_crc,
+                                          uint64_t *crc_out) {
+        HLOGENTRY();
+        const size_t kBufSize = InflateContext::kBufferSize;
+        InflateContextPool::Handle context;
+        if (!inflate_contexts.Acquire(&context)) {
             return kZlibError;
         }
+        z_stream &zstream = *context->GetStream();
+        uint8_t *const read_buf = context->GetReadBuffer();
+        uint8_t *const write_buf = context->GetWriteBuffer();
+        int zerr;
 
-        auto zstream_deleter = [](z_stream *stream) {
-            inflateEnd(stream); /* free up any allocated structures */
-        };
-
-        std::unique_ptr<z_stream, decltype(zstream_deleter)> zstream_guard(&zstream,
-                                                                           zstream_deleter);
-
+        if (decompressor == kDecompressorDefault) {
+            decompressor = this->decompressor;
+        }
         const uint32_t uncompressed_length = entry->uncompressed_length;
+        if (decompressor == kDecompressorDeflate ||
+            (entry->compressed_length <= kBufSize && uncompressed_length <= kBufSize)) {
+            // Whatever does not fit the context buffers and cannot be read
+            // from the mapping or written in place is staged on the heap, up
+            // to kMaxStagedLength bytes in all.
+            const size_t staged_input =
+                    entry->compressed_length > kBufSize &&
+                    mapped_zip->GetDataAt(entry->offset, entry->compressed_length) == nullptr
+                    ? entry->compressed_length : 0;
+            const size_t staged_output =
+                    uncompressed_length > kBufSize && writer->GetDirectBuffer() == nullptr
+                    ? uncompressed_length : 0;
+            if (staged_input + staged_output <= kMaxStagedLength) {
+                std::unique_ptr<uint8_t[]> heap_input(
+                        staged_input != 0 ? new(std::nothrow) uint8_t[staged_input] : nullptr);
+                std::unique_ptr<uint8_t[]> heap_output(
+                        staged_output != 0 ? new(std::nothrow) uint8_t[staged_output] : nullptr);
+                if ((staged_input == 0 || heap_input != nullptr) &&
+                    (staged_output == 0 || heap_output != nullptr)) {
+                    return DecompressEntryToWriter(entry, writer, Decompressor::Get(decompressor),
+                                                   context.get(), heap_input.get(),
+                                                   heap_output.get(), check_crc, crc_out);
+                }
+                HLOGW("Zip: unable to stage %zu bytes, streaming instead",
+                      staged_input + staged_output);
+            }
+        }
+
+        // Larger entries are streamed through zlib. Inflate straight into the
+        // destination when the writer exposes it, otherwise through a bounce
+        // buffer that is Appended when full.
+        uint8_t *const direct = writer->GetDirectBuffer();
+        if (pipeline_threshold != 0 && uncompressed_length >= pipeline_threshold &&
+            (direct == nullptr ||
+             mapped_zip->GetDataAt(entry->offset, entry->compressed_length) == nullptr)) {
+            return InflateEntryPipelined(entry, writer, context.get(), check_crc, crc_out);
+        }
+        if (direct != nullptr) {
+            zstream.next_out = direct;
+            zstream.avail_out = uncompressed_length;
+        } else {
+            zstream.next_out = &write_buf[0];
+            zstream.avail_out = kBufSize;
+        }
 
         uint64_t crc = 0;
         uint32_t compressed_length = entry->compressed_length;
+
+        // When the archive is addressable the whole input is handed to zlib
+        // at once, straight from the mapping.
+        const uint8_t *mapped = mapped_zip->GetDataAt(entry->offset, compressed_length);
+        if (mapped != nullptr) {
+            mapped_zip->WillNeed(entry->offset, compressed_length);
+            // zlib never writes through next_in; it is only const with ZLIB_CONST.
+            zstream.next_in = const_cast<uint8_t *>(mapped);
+            zstream.avail_in = compressed_length;
+            compressed_length = 0;
+        }
+        ChunkReader reader(mapped_zip.get(), use_io_uring ? IoUring::ForThisThread() : nullptr,
+                           read_buf, entry->offset, compressed_length);
         do {
             /* read as much as we can */
-            if (zstream.avail_in == 0) {
-                const size_t getSize = (compressed_length > kBufSize) ? kBufSize
-                                                                      : compressed_length;
-                if (!mapped_zip->ReadData(read_buf.data(), getSize)) {
-                    HLOGW("Zip: inflate read failed, getSize = %zu: %s", getSize, strerror(errno));
+            if (zstream.avail_in == 0 && reader.GetRemaining() != 0) {
+                const uint8_t *chunk;
+                size_t chunk_size;
+                if (!reader.Next(&chunk, &chunk_size)) {
+                    HLOGW("Zip: inflate read failed: %s", strerror(errno));
                     return kIoError;
                 }
 
-                compressed_length -= getSize;
-
-                zstream.next_in = &read_buf[0];
-                zstream.avail_in = getSize;
+                // zlib never writes through next_in; it is only const with ZLIB_CONST.
+                zstream.next_in = const_cast<uint8_t *>(chunk);
+                zstream.avail_in = chunk_size;
             }
 
             /* uncompress the data */
             zerr = inflate(&zstream, Z_NO_FLUSH);
+            if (direct != nullptr && zerr == Z_BUF_ERROR && zstream.avail_out == 0) {
+                // The stream holds more than the declared length.
+                HLOGW("Zip: inflated data overruns declared length %" PRIu32, uncompressed_length);
+                return kInconsistentInformation;
+            }
             if (zerr != Z_OK && zerr != Z_STREAM_END) {
                 HLOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)", zerr, zstream.next_in,
                       zstream.avail_in, zstream.next_out, zstream.avail_out);
@@ -711,13 +1023,14 @@ namespace hms {
             }
 
             /* write when we're full or when we're done */
-            if (zstream.avail_out == 0 || (zerr == Z_STREAM_END && zstream.avail_out != kBufSize)) {
+            if (direct == nullptr &&
+                (zstream.avail_out == 0 || (zerr == Z_STREAM_END && zstream.avail_out != kBufSize))) {
                 const size_t write_size = zstream.next_out - &write_buf[0];
                 if (!writer->Append(&write_buf[0], write_size)) {
                     // The file might have declared a bogus length.
                     return kInconsistentInformation;
-                } else {
-                    crc = crc32(crc, &write_buf[0], write_size);
+                } else if (check_crc) {
+                    crc = Crc32::Update(crc, &write_buf[0], write_size);
                 }
 
                 zstream.next_out = &write_buf[0];
@@ -727,6 +1040,10 @@ namespace hms {
 
         assert(zerr == Z_STREAM_END); /* other errors should've been caught */
 
+        if (direct != nullptr && check_crc) {
+            crc = Crc32::Update(crc, direct, zstream.total_out);
+        }
+
         // NOTE: zstream.adler is always set to 0, because we're using the -MAX_WBITS
         // "feature" of zlib to tell it there won't be a zlib file header. zlib
         // doesn't bother calculating the checksum in that scenario. We just do
@@ -735,7 +1052,7 @@ namespace hms {
         // the same manner that we have above.
         *crc_out = crc;
 
-        if (zstream.total_out != uncompressed_length || compressed_length != 0) {
+        if (zstream.total_out != uncompressed_length || reader.GetRemaining() != 0) {
             HLOGW("Zip: size mismatch on inflated file (%lu vs %"
                           PRIu32
                           ")", zstream.total_out,
@@ -746,33 +1063,251 @@ namespace hms {
         return 0;
     }
 
-    int32_t ZipFile::CopyEntryToWriter(const ZipEntry *entry,
-                                       Writer *writer,
-                                       uint64_t *crc_out) {
+    // Buffers in flight between two pipeline stages, and their size.
+    static const size_t kPipelineDepth = 8;
+    static const size_t kPipelineChunkSize = 128 * 1024;
+
+    namespace {
+        struct PipelineChunk {
+            uint8_t *data;
+            size_t size;
+        };
+
+        // Holds every buffer of a stage, so a queue never fills up, plus the
+        // end marker.
+        typedef SpscQueue<PipelineChunk, 2 * kPipelineDepth> PipelineQueue;
+    }
+
+    int32_t ZipFile::InflateEntryPipelined(const ZipEntry *entry, Writer *writer,
+                                           InflateContext *context, bool check_crc,
+                                           uint64_t *crc_out) {
         HLOGENTRY();
-        static const uint32_t kBufSize = 32768;
-        std::vector<uint8_t> buf(kBufSize);
+        const uint32_t compressed_length = entry->compressed_length;
+        const uint32_t uncompressed_length = entry->uncompressed_length;
+        z_stream &zstream = *context->GetStream();
+
+        // A mapped archive needs no reader stage and a writer that exposes
+        // its destination no writer stage.
+        const uint8_t *const mapped = mapped_zip->GetDataAt(entry->offset, compressed_length);
+        uint8_t *const direct = writer->GetDirectBuffer();
+        const size_t num_buffers = kPipelineDepth * ((mapped == nullptr) + (direct == nullptr));
+        std::unique_ptr<uint8_t[]> buffers(new uint8_t[num_buffers * kPipelineChunkSize]);
+
+        // Empty buffers flow from the consumer back to the producer of each
+        // stage through the *_free queues, filled ones through *_full.
+        PipelineQueue read_free, read_full, write_free, write_full;
+        uint8_t *next_buffer = buffers.get();
+        for (size_t i = 0; i < kPipelineDepth; ++i) {
+            if (mapped == nullptr) {
+                read_free.TryPush(PipelineChunk{next_buffer, 0});
+                next_buffer += kPipelineChunkSize;
+            }
+            if (direct == nullptr) {
+                write_free.TryPush(PipelineChunk{next_buffer, 0});
+                next_buffer += kPipelineChunkSize;
+            }
+        }
 
+        // Set by whichever stage fails first, and once the entry is inflated:
+        // the reader may still wait for a buffer if the deflate stream ends
+        // early, while the writer takes what was queued before stopping.
+        std::atomic<bool> stop(false);
+        int32_t read_error = 0;
+        int32_t write_error = 0;
+
+        std::thread reader;
+        if (mapped == nullptr) {
+            reader = std::thread([&]() {
+                off64_t offset = entry->offset;
+                uint32_t remaining = compressed_length;
+                PipelineChunk chunk;
+                while (remaining > 0 && read_free.Pop(&chunk, stop)) {
+                    chunk.size = std::min<size_t>(remaining, kPipelineChunkSize);
+                    if (!mapped_zip->ReadAtOffset(chunk.data, chunk.size, offset)) {
+                        HLOGW("Zip: inflate read failed: %s", strerror(errno));
+                        read_error = kIoError;
+                        stop = true;
+                        return;
+                    }
+                    offset += chunk.size;
+                    remaining -= chunk.size;
+                    read_full.Push(chunk, stop);
+                }
+            });
+        }
+
+        std::thread appender;
+        if (direct == nullptr) {
+            appender = std::thread([&]() {
+                PipelineChunk chunk;
+                // A chunk without data marks the end of the entry.
+                while (write_full.Pop(&chunk, stop) && chunk.data != nullptr) {
+                    if (!writer->Append(chunk.data, chunk.size)) {
+                        // The file might have declared a bogus length.
+                        write_error = kInconsistentInformation;
+                        stop = true;
+                        return;
+                    }
+                    write_free.Push(chunk, stop);
+                }
+            });
+        }
+
+        uint64_t crc = 0;
+        int32_t result = 0;
+        uint32_t to_receive = 0;
+        PipelineChunk input = {nullptr, 0};
+        PipelineChunk output = {nullptr, 0};
+        if (mapped != nullptr) {
+            mapped_zip->WillNeed(entry->offset, compressed_length);
+            // zlib never writes through next_in; it is only const with ZLIB_CONST.
+            zstream.next_in = const_cast<uint8_t *>(mapped);
+            zstream.avail_in = compressed_length;
+        } else {
+            zstream.avail_in = 0;
+            to_receive = compressed_length;
+        }
+        if (direct != nullptr) {
+            zstream.next_out = direct;
+            zstream.avail_out = uncompressed_length;
+        } else {
+            zstream.avail_out = 0;
+        }
+
+        int zerr = Z_OK;
+        while (zerr == Z_OK) {
+            if (zstream.avail_in == 0 && to_receive != 0) {
+                if (input.data != nullptr) {
+                    read_free.Push(input, stop);
+                }
+                if (!read_full.Pop(&input, stop)) {
+                    result = kIoError;
+                    break;
+                }
+                zstream.next_in = input.data;
+                zstream.avail_in = input.size;
+                to_receive -= input.size;
+            }
+            if (direct == nullptr && zstream.avail_out == 0) {
+                if (!write_free.Pop(&output, stop)) {
+                    result = kIoError;
+                    break;
+                }
+                zstream.next_out = output.data;
+                zstream.avail_out = kPipelineChunkSize;
+            }
+
+            zerr = inflate(&zstream, Z_NO_FLUSH);
+            if (direct != nullptr && zerr == Z_BUF_ERROR && zstream.avail_out == 0) {
+                // The stream holds more than the declared length.
+                HLOGW("Zip: inflated data overruns declared length %" PRIu32, uncompressed_length);
+                result = kInconsistentInformation;
+                break;
+            }
+            if (zerr != Z_OK && zerr != Z_STREAM_END) {
+                HLOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)", zerr, zstream.next_in,
+                      zstream.avail_in, zstream.next_out, zstream.avail_out);
+                result = kZlibError;
+                break;
+            }
+
+            // Hand the output on when it is full or when we're done.
+            if (direct == nullptr && (zstream.avail_out == 0 || zerr == Z_STREAM_END)) {
+                output.size = zstream.next_out - output.data;
+                if (check_crc) {
+                    crc = Crc32::Update(crc, output.data, output.size);
+                }
+                write_full.Push(output, stop);
+                zstream.avail_out = 0;
+            }
+        }
+
+        if (result == 0) {
+            write_full.Push(PipelineChunk{nullptr, 0}, stop);
+        }
+        stop = true;
+        if (reader.joinable()) {
+            reader.join();
+        }
+        if (appender.joinable()) {
+            appender.join();
+        }
+        // A stage that failed first caused the error seen here.
+        if (read_error != 0) {
+            return read_error;
+        }
+        if (write_error != 0) {
+            return write_error;
+        }
+        if (result != 0) {
+            return result;
+        }
+
+        if (direct != nullptr && check_crc) {
+            crc = Crc32::Update(crc, direct, zstream.total_out);
+        }
+        *crc_out = crc;
+
+        if (zstream.total_out != uncompressed_length || to_receive != 0) {
+            HLOGW("Zip: size mismatch on inflated file (%lu vs %" PRIu32 ")", zstream.total_out,
+                  uncompressed_length);
+            return kInconsistentInformation;
+        }
+        return 0;
+    }
+
+    int32_t ZipFile::CopyEntryToWriter(const ZipEntry *entry, Writer *writer,
+                                       bool check_crc, uint64_t *crc_out) {
+        HLOGENTRY();
         const uint32_t length = entry->uncompressed_length;
         uint32_t count = 0;
+
+        // Without CRC verification the bytes never need to reach user space,
+        // so let the kernel copy them from the archive to the destination.
+        if (!check_crc && mapped_zip->HasFd()) {
+            const ssize_t copied = writer->CopyFileRange(mapped_zip->GetFileDescriptor(),
+                                                         entry->offset, length);
+            if (copied < 0) {
+                return kIoError;
+            }
+            count = static_cast<uint32_t>(copied);
+            if (count == length) {
+                *crc_out = 0;
+                return 0;
+            }
+        }
+
+        const uint8_t *mapped = mapped_zip->GetDataAt(entry->offset, length);
+        if (mapped != nullptr && count == 0) {
+            mapped_zip->WillNeed(entry->offset, length);
+            if (!writer->Append(mapped, length)) {
+                return kIoError;
+            }
+            *crc_out = check_crc ? Crc32::Update(0, mapped, length) : 0;
+            return 0;
+        }
+
+        InflateContextPool::Handle context;
+        if (!inflate_contexts.Acquire(&context)) {
+            return kIoError;
+        }
+        ChunkReader reader(mapped_zip.get(), use_io_uring ? IoUring::ForThisThread() : nullptr,
+                           context->GetReadBuffer(), entry->offset + count, length - count);
         uint64_t crc = 0;
-        while (count < length) {
-            uint32_t remaining = length - count;
-
-            // Safe conversion because kBufSize is narrow enough for a 32 bit signed
-            // value.
-            const size_t block_size = (remaining > kBufSize) ? kBufSize : remaining;
-            if (!mapped_zip->ReadData(buf.data(), block_size)) {
-                HLOGW("CopyFileToFile: copy read failed, block_size = %zu: %s", block_size,
-                      strerror(errno));
+        while (reader.GetRemaining() != 0) {
+            const uint8_t *buf;
+            size_t block_size;
+            if (!reader.Next(&buf, &block_size)) {
+                HLOGW("CopyFileToFile: copy read failed: %s", strerror(errno));
                 return kIoError;
             }
 
-            if (!writer->Append(&buf[0], block_size)) {
+            if (!writer->Append(buf, block_size)) {
                 return kIoError;
             }
-            crc = crc32(crc, &buf[0], block_size);
-            count += block_size;
+            if (check_crc) {
+                crc = Crc32::Update(crc, buf, block_size);
+            }
         }
 
         *crc_out = crc;
@@ -780,25 +1315,26 @@ namespace hms {
         return 0;
     }
 
-    int32_t ZipFile::ExtractToWriter(ZipEntry *entry, Writer *writer) {
+    int32_t ZipFile::ExtractToWriter(ZipEntry *entry, Writer *writer,
+                                     DecompressorType decompressor, bool check_crc) {
         HLOGENTRY();
-        const uint16_t method = entry->method;
-        off64_t data_offset = entry->offset;
-
-        if (!mapped_zip->SeekToOffset(data_offset)) {
-            HLOGW("Zip: lseek to data at %"
-                          PRId64
-                          " failed", static_cast<int64_t>(data_offset));
-            return kIoError;
+        if (entry->offset == 0) {
+            // Entries from a metadata-only iteration are validated on first use.
+            const int32_t error = ValidateLocalFileHeader(entry);
+            if (error != 0) {
+                return error;
+            }
         }
 
+        const uint16_t method = entry->method;
+
         // this should default to kUnknownCompressionMethod.
         int32_t return_value = -1;
         uint64_t crc = 0;
         if (method == kCompressStored) {
-            return_value = CopyEntryToWriter(entry, writer, &crc);
+            return_value = CopyEntryToWriter(entry, writer, check_crc, &crc);
         } else if (method == kCompressDeflated) {
-            return_value = InflateEntryToWriter(entry, writer, &crc);
+            return_value = InflateEntryToWriter(entry, writer, decompressor, check_crc, &crc);
         }
 
         if (!return_value && entry->has_data_descriptor) {
@@ -808,8 +1344,12 @@ namespace hms {
             }
         }
 
+        if (return_value == 0 && !writer->Flush()) {
+            return kIoError;
+        }
+
         // Validate that the CRC matches the calculated value.
-        if (kCrcChecksEnabled && (entry->crc32 != static_cast<uint32_t>(crc))) {
+        if (return_value == 0 && check_crc && (entry->crc32 != static_cast<uint32_t>(crc))) {
             HLOGW("Zip: crc mismatch: expected %"
                           PRIu32
                           ", was %"
@@ -820,14 +1360,637 @@ namespace hms {
         return return_value;
     }
 
-    int32_t ZipFile::ExtractEntryToFile(ZipEntry *entry, int fd) {
+    int32_t ZipFile::ExtractEntryToFile(ZipEntry *entry, int fd,
+                                        DecompressorType decompressor) {
         HLOGENTRY();
-        std::unique_ptr<Writer> writer(FileWriter::Create(fd, entry));
+        ExtractOptions options;
+        options.decompressor = decompressor;
+        return ExtractEntryToFd(entry, fd, options);
+    }
+
+    int32_t ZipFile::ExtractEntryToFd(ZipEntry *entry, int fd, const ExtractOptions &options) {
+        std::unique_ptr<Writer> writer;
+        // Only ExtractEntryAt opens files with O_DIRECT.
+        if (options.direct_io) {
+            writer = DirectFileWriter::Create(fd, entry);
+        }
+        // Stored entries are better served by CopyFileRange on a plain fd.
+        // Pages dirtied through a mapping cannot be dropped as they are written.
+        if (writer.get() == nullptr && !options.drop_destination_cache &&
+            entry->method == kCompressDeflated &&
+            entry->uncompressed_length >= kMappedWriterThreshold) {
+            writer = MappedFileWriter::Create(fd, entry);
+        }
+        // Entries streamed in several chunks can batch their writes.
+        if (writer.get() == nullptr && !options.drop_destination_cache && use_io_uring &&
+            entry->method == kCompressDeflated &&
+            entry->uncompressed_length > InflateContext::kBufferSize) {
+            IoUring *ring = IoUring::ForThisThread();
+            if (ring != nullptr) {
+                writer = UringFileWriter::Create(fd, entry, ring);
+            }
+        }
+        if (writer.get() == nullptr) {
+            writer = FileWriter::Create(fd, entry, options.drop_destination_cache);
+        }
         if (writer.get() == nullptr) {
             return kIoError;
         }
 
-        return ExtractToWriter(entry, writer.get());
+        return ExtractToWriter(entry, writer.get(), options.decompressor, verify_crc);
+    }
+
+    int32_t ZipFile::ExtractEntryToMemory(ZipEntry *entry, std::vector<uint8_t> *out,
+                                          DecompressorType decompressor) {
+        HLOGENTRY();
+        MemoryWriter writer(out, entry->uncompressed_length);
+        const int32_t error = ExtractToWriter(entry, &writer, decompressor, verify_crc);
+        if (error != 0) {
+            out->clear();
+        }
+        return error;
+    }
+
+    int32_t ZipFile::ExtractEntryToMemory(ZipEntry *entry, uint8_t *buf, size_t size,
+                                          DecompressorType decompressor) {
+        HLOGENTRY();
+        if (entry->uncompressed_length > size) {
+            HLOGW("Zip: entry of %" PRIu32 " bytes does not fit a buffer of %zu",
+                  entry->uncompressed_length, size);
+            return kIoError;
+        }
+        BufferWriter writer(buf, size, entry->uncompressed_length);
+        return ExtractToWriter(entry, &writer, decompressor, verify_crc);
+    }
+
+    int32_t ZipFile::ExtractEntryToWriter(ZipEntry *entry, Writer *writer,
+                                          DecompressorType decompressor) {
+        HLOGENTRY();
+        return ExtractToWriter(entry, writer, decompressor, verify_crc);
+    }
+
+    void ZipFile::MapArchiveForViews() {
+        std::call_once(view_map_once, [this]() {
+            view_map = mapped_zip->GetArchiveMap();
+            if (view_map != nullptr || !mapped_zip->HasFd()) {
+                return;
+            }
+
+            const off64_t length = mapped_zip->GetFileLength();
+            std::shared_ptr<FileMap> map(new FileMap());
+            if (length <= 0 || static_cast<uint64_t>(length) > SIZE_MAX ||
+                !map->create(mArchiveName, mapped_zip->GetFileDescriptor(), 0,
+                             static_cast<size_t>(length), true)) {
+                HLOGW("Zip: unable to map '%s' for entry views", mArchiveName);
+                return;
+            }
+            view_map = map;
+        });
+    }
+
+    int32_t ZipFile::OpenEntryView(ZipEntry *entry, EntryView *view) {
+        HLOGENTRY();
+        if (entry->method != kCompressStored) {
+            HLOGW("Zip: entry %" PRIu32 " is compressed, no view possible", entry->index);
+            return kEntryCompressed;
+        }
+
+        if (entry->offset == 0) {
+            // Entries from a metadata-only iteration are validated on first use.
+            const int32_t error = ValidateLocalFileHeader(entry);
+            if (error != 0) {
+                return error;
+            }
+        }
+
+        MapArchiveForViews();
+        if (view_map == nullptr && mapped_zip->HasFd()) {
+            return kMmapFailed;
+        }
+
+        const size_t length = entry->uncompressed_length;
+        const uint8_t *data;
+        if (view_map != nullptr) {
+            const size_t map_length = view_map->getDataLength();
+            if (static_cast<uint64_t>(entry->offset) > map_length ||
+                length > map_length - static_cast<size_t>(entry->offset)) {
+                HLOGW("Zip: entry %" PRIu32 " overruns the archive", entry->index);
+                return kInvalidOffset;
+            }
+            data = static_cast<const uint8_t *>(view_map->getDataPtr()) + entry->offset;
+        } else {
+            data = mapped_zip->GetDataAt(entry->offset, length);
+            if (data == nullptr) {
+                return kInvalidOffset;
+            }
+        }
+
+        view->map_ = view_map;
+        view->data_ = data;
+        view->length_ = length;
+        return 0;
+    }
+
+    int32_t ZipFile::OpenEntryReader(ZipEntry *entry, EntryReader *reader) {
+        HLOGENTRY();
+        reader->Reset();
+        if (entry->method != kCompressStored && entry->method != kCompressDeflated) {
+            HLOGW("Zip: entry %" PRIu32 " has unsupported compression method %" PRIu16,
+                  entry->index, entry->method);
+            return kInconsistentInformation;
+        }
+
+        if (entry->offset == 0) {
+            // Entries from a metadata-only iteration are validated on first use.
+            const int32_t error = ValidateLocalFileHeader(entry);
+            if (error != 0) {
+                return error;
+            }
+        }
+        if (entry->has_data_descriptor) {
+            const int32_t error = ValidateDataDescriptor(entry);
+            if (error != 0) {
+                return error;
+            }
+        }
+
+        if (!inflate_contexts.Acquire(&reader->context_)) {
+            return kZlibError;
+        }
+        const bool deflated = entry->method == kCompressDeflated;
+        const uint32_t input_length = deflated ? entry->compressed_length
+                                               : entry->uncompressed_length;
+        reader->zip_ = mapped_zip.get();
+        reader->deflated_ = deflated;
+        reader->check_crc_ = verify_crc;
+        reader->expected_crc_ = entry->crc32;
+        reader->mapped_ = mapped_zip->GetDataAt(entry->offset, input_length);
+        reader->input_offset_ = entry->offset;
+        reader->input_remaining_ = input_length;
+        reader->unproduced_ = entry->uncompressed_length;
+        reader->remaining_ = entry->uncompressed_length;
+
+        // An empty entry has nothing to pull, so check it now.
+        if (reader->unproduced_ == 0) {
+            reader->error_ = reader->Finish();
+            return reader->error_;
+        }
+        return 0;
+    }
+
+    int32_t ZipFile::BuildSeekIndex(ZipEntry *entry, SeekIndex *index, uint32_t spacing) {
+        HLOGENTRY();
+        index->Clear();
+        if (entry->offset == 0) {
+            // Entries from a metadata-only iteration are validated on first use.
+            const int32_t error = ValidateLocalFileHeader(entry);
+            if (error != 0) {
+                return error;
+            }
+        }
+        if (entry->method == kCompressStored) {
+            index->SetEntry(*entry, spacing);
+            return 0;
+        }
+        if (entry->method != kCompressDeflated) {
+            HLOGW("Zip: entry %" PRIu32 " has unsupported compression method %" PRIu16,
+                  entry->index, entry->method);
+            return kInconsistentInformation;
+        }
+        if (entry->has_data_descriptor) {
+            const int32_t error = ValidateDataDescriptor(entry);
+            if (error != 0) {
+                return error;
+            }
+        }
+
+        InflateContextPool::Handle context;
+        if (!inflate_contexts.Acquire(&context)) {
+            return kZlibError;
+        }
+        const int32_t error = index->Build(mapped_zip.get(), *entry, context.get(),
+                                           std::max<uint32_t>(spacing, 1), verify_crc);
+        if (error != 0) {
+            index->Clear();
+        }
+        return error;
+    }
+
+    int64_t ZipFile::ReadAt(ZipEntry *entry, const SeekIndex &index, uint64_t offset,
+                            void *buf, size_t len) {
+        HLOGENTRY();
+        if (entry->offset == 0) {
+            // Entries from a metadata-only iteration are validated on first use.
+            const int32_t error = ValidateLocalFileHeader(entry);
+            if (error != 0) {
+                return error;
+            }
+        }
+        if (!index.Matches(*entry)) {
+            HLOGW("Zip: seek index does not belong to entry %" PRIu32, entry->index);
+            return kInconsistentInformation;
+        }
+        if (offset >= entry->uncompressed_length) {
+            return 0;
+        }
+
+        if (entry->method == kCompressStored) {
+            len = static_cast<size_t>(std::min<uint64_t>(len, entry->uncompressed_length - offset));
+            if (!mapped_zip->ReadAtOffset(static_cast<uint8_t *>(buf), len,
+                                          entry->offset + offset)) {
+                HLOGW("Zip: read of %zu bytes failed: %s", len, strerror(errno));
+                return kIoError;
+            }
+            return static_cast<int64_t>(len);
+        }
+
+        InflateContextPool::Handle context;
+        if (!inflate_contexts.Acquire(&context)) {
+            return kZlibError;
+        }
+        return index.Read(mapped_zip.get(), *entry, context.get(), offset,
+                          static_cast<uint8_t *>(buf), len);
+    }
+
+    // Returns "false" for names that would land outside the target directory.
+    static bool IsSafeEntryPath(const ZipString &name) {
+        if (name.name_length == 0 || name.name[0] == '/') {
+            return false;
+        }
+        uint16_t start = 0;
+        for (uint16_t i = 0; i <= name.name_length; ++i) {
+            if (i == name.name_length || name.name[i] == '/') {
+                if (i - start == 2 && name.name[start] == '.' && name.name[start + 1] == '.') {
+                    return false;
+                }
+                start = i + 1;
+            }
+        }
+        return true;
+    }
+
+    // Extended attribute recording which entry a file was extracted from.
+    static const char kExtractStampName[] = "user.hms.extract";
+
+    namespace {
+        // Value of kExtractStampName. The file's inode and mtime tie the
+        // stamp to the contents it was recorded for; rewriting or replacing
+        // the file invalidates it.
+        struct ExtractStamp {
+            uint32_t crc32;
+            uint32_t reserved;
+            uint64_t size;
+            uint64_t ino;
+            int64_t mtime_sec;
+            int64_t mtime_nsec;
+        } __attribute__((packed));
+    }
+
+    static void MakeExtractStamp(const ZipEntry &entry, const struct stat &sb,
+                                 ExtractStamp *stamp) {
+        memset(stamp, 0, sizeof(*stamp));
+        stamp->crc32 = entry.crc32;
+        stamp->size = entry.uncompressed_length;
+        stamp->ino = sb.st_ino;
+        stamp->mtime_sec = sb.st_mtim.tv_sec;
+        stamp->mtime_nsec = sb.st_mtim.tv_nsec;
+    }
+
+    // Stamp |fd|, which holds |entry|. Failures are ignored; the file is
+    // then compared by contents next time.
+    static void WriteExtractStamp(int fd, const ZipEntry &entry) {
+        struct stat sb{};
+        if (fstat(fd, &sb) != 0) {
+            return;
+        }
+        ExtractStamp stamp;
+        MakeExtractStamp(entry, sb, &stamp);
+        fsetxattr(fd, kExtractStampName, &stamp, sizeof(stamp), 0);
+    }
+
+    // Error for an entry whose destination could not be opened below the
+    // target directory.
+    static int32_t DestinationError(const ZipString &name) {
+        if (errno == ELOOP) {
+            HLOGW("Zip: refusing to extract %.*s through a symbolic link", name.name_length,
+                  name.name);
+            return kInvalidEntryName;
+        }
+        HLOGW("Zip: unable to create %.*s: %s", name.name_length, name.name, strerror(errno));
+        return kIoError;
+    }
+
+    bool ZipFile::DestinationMatches(uint32_t ent, int dir_fd, const std::string &file_name) {
+        // The central directory is enough; the archive itself is not read.
+        ZipEntry entry;
+        FillEntryFromIndex(ent, &entry);
+
+        struct stat sb{};
+        if (fstatat(dir_fd, file_name.c_str(), &sb, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISREG(sb.st_mode) ||
+            static_cast<uint64_t>(sb.st_size) != entry.uncompressed_length) {
+            return false;
+        }
+
+        const int fd = TEMP_FAILURE_RETRY(
+                openat(dir_fd, file_name.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+        if (fd == -1) {
+            return false;
+        }
+        // Make sure it is still the file that was checked.
+        struct stat fd_sb{};
+        if (fstat(fd, &fd_sb) != 0 || fd_sb.st_ino != sb.st_ino || fd_sb.st_dev != sb.st_dev) {
+            close(fd);
+            return false;
+        }
+
+        ExtractStamp expected;
+        MakeExtractStamp(entry, fd_sb, &expected);
+        ExtractStamp stamp;
+        if (fgetxattr(fd, kExtractStampName, &stamp, sizeof(stamp)) ==
+            static_cast<ssize_t>(sizeof(stamp)) &&
+            memcmp(&stamp, &expected, sizeof(stamp)) == 0) {
+            close(fd);
+            return true;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        const size_t kBufSize = InflateContext::kBufferSize;
+        std::unique_ptr<uint8_t[]> buf(new uint8_t[kBufSize]);
+        uint32_t crc = 0;
+        uint64_t total = 0;
+        ssize_t n;
+        while ((n = TEMP_FAILURE_RETRY(read(fd, buf.get(), kBufSize))) > 0) {
+            crc = Crc32::Update(crc, buf.get(), static_cast<size_t>(n));
+            total += static_cast<uint64_t>(n);
+        }
+        const bool matches = n == 0 && total == entry.uncompressed_length && crc == entry.crc32;
+        if (matches) {
+            WriteExtractStamp(fd, entry);
+        }
+        close(fd);
+        return matches;
+    }
+
+    int32_t ZipFile::ExtractEntryAt(uint32_t ent, int dir_fd, const std::string &file_name,
+                                    const ExtractOptions &options, uint64_t *bytes_written) {
+        ZipEntry entry;
+        int32_t err = FindEntry(ent, &entry);
+        if (err != 0) {
+            return err;
+        }
+
+        // O_NOFOLLOW: an existing symbolic link must not redirect the write.
+        const mode_t mode = (entry.unix_mode & 0777) != 0 ? (entry.unix_mode & 0777) : 0644;
+        int flags = O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW;
+        if (options.direct_io && entry.uncompressed_length >= ExtractOptions::kDirectIoThreshold) {
+            flags |= O_DIRECT;
+        }
+        int fd = TEMP_FAILURE_RETRY(openat(dir_fd, file_name.c_str(), flags, mode));
+        if (fd == -1 && errno == EINVAL && (flags & O_DIRECT) != 0) {
+            // The file system does not do O_DIRECT.
+            fd = TEMP_FAILURE_RETRY(openat(dir_fd, file_name.c_str(), flags & ~O_DIRECT, mode));
+        }
+        if (fd == -1) {
+            return DestinationError(entry_index.GetName(ent));
+        }
+
+        if (options.drop_source_cache) {
+            mapped_zip->WillReadOnce(entry.offset, entry.compressed_length);
+        }
+        err = ExtractEntryToFd(&entry, fd, options);
+        if (options.drop_source_cache) {
+            mapped_zip->DontNeed(entry.offset, entry.compressed_length);
+        }
+        if (err == 0 && options.skip_unchanged) {
+            WriteExtractStamp(fd, entry);
+        }
+        if (close(fd) != 0 && err == 0) {
+            err = kIoError;
+        }
+        if (err != 0) {
+            // Don't leave a truncated file behind.
+            unlinkat(dir_fd, file_name.c_str(), 0);
+            return err;
+        }
+        *bytes_written = entry.uncompressed_length;
+        return 0;
+    }
+
+    int32_t ZipFile::ExtractAll(const EntryFilter &filter, const char *target_dir,
+                                const ExtractOptions &options, ExtractReport *report) {
+        HLOGENTRY();
+        if (!entry_index.IsValid() || target_dir == nullptr || report == nullptr) {
+            HLOGW("Zip: Invalid ZipFileHandle");
+            return kInvalidHandle;
+        }
+
+        // Everything below is created and opened relative to the target
+        // directory, never through a symbolic link, so that nothing already
+        // in it can redirect a write elsewhere.
+        *report = ExtractReport();
+        const int root_fd = File::MakeDirs(target_dir)
+                            ? TEMP_FAILURE_RETRY(open(target_dir,
+                                                      O_RDONLY | O_DIRECTORY | O_CLOEXEC))
+                            : -1;
+        if (root_fd == -1) {
+            HLOGW("Zip: unable to open %s: %s", target_dir, strerror(errno));
+            return kIoError;
+        }
+
+        std::vector<ExtractResult> &results = report->results;
+        for (uint32_t i = 0; i < num_entries; ++i) {
+            const ZipString name = entry_index.GetName(i);
+            if (filter && !filter(name)) {
+                continue;
+            }
+            ExtractResult result;
+            result.index = i;
+            result.name = name;
+            result.error = 0;
+            result.bytes_written = 0;
+            result.skipped = false;
+            results.push_back(result);
+        }
+
+        // Create the directories before any file is written, so the workers
+        // never race on mkdir.
+        std::set<std::string> dirs;
+        std::vector<size_t> files;
+        for (size_t i = 0; i < results.size(); ++i) {
+            ExtractResult &result = results[i];
+            if (!IsSafeEntryPath(result.name)) {
+                HLOGW("Zip: refusing to extract %.*s", result.name.name_length,
+                      result.name.name);
+                result.error = kInvalidEntryName;
+                continue;
+            }
+
+            const std::string name(reinterpret_cast<const char *>(result.name.name),
+                                   result.name.name_length);
+            if (name.back() == '/') {
+                // An entry for the directory itself.
+                dirs.insert(name);
+            } else {
+                const size_t slash = name.rfind('/');
+                dirs.insert(slash == std::string::npos ? std::string() : name.substr(0, slash));
+                files.push_back(i);
+            }
+        }
+        for (const std::string &dir : dirs) {
+            const int fd = File::OpenDirBeneath(root_fd, dir, true);
+            if (fd == -1) {
+                HLOGW("Zip: unable to create directory %s: %s", dir.c_str(), strerror(errno));
+            } else {
+                close(fd);
+            }
+        }
+        for (ExtractResult &result : results) {
+            if (result.error == 0 && result.name.name[result.name.name_length - 1] == '/') {
+                const std::string name(reinterpret_cast<const char *>(result.name.name),
+                                       result.name.name_length);
+                const int fd = File::OpenDirBeneath(root_fd, name, false);
+                if (fd == -1) {
+                    result.error = DestinationError(result.name);
+                } else {
+                    close(fd);
+                }
+            }
+        }
+
+        const EntryIndex &index = entry_index;
+        std::stable_sort(files.begin(), files.end(),
+                         [&index, &results](size_t lhs, size_t rhs) {
+                             return index.GetCompressedLength(results[lhs].index) >
+                                    index.GetCompressedLength(results[rhs].index);
+                         });
+
+        WorkStealingPool pool(options.num_threads);
+        pool.Run(files.size(), [this, &options, root_fd, &files, &results](size_t task) {
+            ExtractResult &result = results[files[task]];
+            const std::string name(reinterpret_cast<const char *>(result.name.name),
+                                   result.name.name_length);
+            const size_t slash = name.rfind('/');
+            const std::string file_name =
+                    slash == std::string::npos ? name : name.substr(slash + 1);
+            const int dir_fd = File::OpenDirBeneath(
+                    root_fd, slash == std::string::npos ? std::string() : name.substr(0, slash),
+                    false);
+            if (dir_fd == -1) {
+                result.error = DestinationError(result.name);
+                return;
+            }
+            if (options.skip_unchanged && DestinationMatches(result.index, dir_fd, file_name)) {
+                result.skipped = true;
+            } else {
+                result.error = ExtractEntryAt(result.index, dir_fd, file_name, options,
+                                              &result.bytes_written);
+            }
+            close(dir_fd);
+        });
+        close(root_fd);
+
+        int32_t first_error = 0;
+        for (const ExtractResult &result : results) {
+            if (result.error != 0) {
+                HLOGW("Zip: failed to extract %.*s: %s", result.name.name_length,
+                      result.name.name, ErrorCodeString(result.error));
+                ++report->num_failed;
+                if (first_error == 0) {
+                    first_error = result.error;
+                }
+            } else if (result.skipped) {
+                ++report->num_skipped;
+            } else {
+                ++report->num_extracted;
+                report->bytes_written += result.bytes_written;
+            }
+        }
+        HLOGI("+++ extracted %u entries (%" PRIu64 " bytes), %u unchanged, %u failed, "
+              "on %zu threads", report->num_extracted, report->bytes_written,
+              report->num_skipped, report->num_failed, pool.GetNumThreads());
+        return first_error;
+    }
+
+    int32_t ZipFile::VerifyEntry(uint32_t ent, DecompressorType decompressor) {
+        ZipEntry entry;
+        const int32_t err = FindEntry(ent, &entry);
+        if (err != 0) {
+            return err;
+        }
+
+        DiscardWriter writer(entry.uncompressed_length);
+        return ExtractToWriter(&entry, &writer, decompressor, true);
+    }
+
+    int32_t ZipFile::VerifyAll(const EntryFilter &filter, const VerifyOptions &options,
+                               VerifyReport *report) {
+        HLOGENTRY();
+        if (!entry_index.IsValid() || report == nullptr) {
+            HLOGW("Zip: Invalid ZipFileHandle");
+            return kInvalidHandle;
+        }
+
+        std::vector<VerifyResult> &results = report->results;
+        results.clear();
+        std::vector<size_t> order;
+        for (uint32_t i = 0; i < num_entries; ++i) {
+            const ZipString name = entry_index.GetName(i);
+            if (filter && !filter(name)) {
+                continue;
+            }
+            VerifyResult result;
+            result.index = i;
+            result.name = name;
+            result.error = kCancelled;
+            order.push_back(results.size());
+            results.push_back(result);
+        }
+
+        const EntryIndex &index = entry_index;
+        std::stable_sort(order.begin(), order.end(),
+                         [&index, &results](size_t lhs, size_t rhs) {
+                             return index.GetCompressedLength(results[lhs].index) >
+                                    index.GetCompressedLength(results[rhs].index);
+                         });
+
+        std::atomic<bool> failed(false);
+        WorkStealingPool pool(options.num_threads);
+        pool.Run(order.size(), [this, &options, &order, &results, &failed](size_t task) {
+            if (options.stop_on_failure && failed.load(std::memory_order_relaxed)) {
+                return;
+            }
+            VerifyResult &result = results[order[task]];
+            result.error = VerifyEntry(result.index, options.decompressor);
+            if (result.error != 0) {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        });
+
+        int32_t first_error = 0;
+        report->num_verified = 0;
+        report->num_failed = 0;
+        report->num_skipped = 0;
+        report->bytes_verified = 0;
+        for (const VerifyResult &result : results) {
+            if (result.error == kCancelled) {
+                ++report->num_skipped;
+            } else if (result.error != 0) {
+                HLOGW("Zip: %.*s failed verification: %s", result.name.name_length,
+                      result.name.name, ErrorCodeString(result.error));
+                ++report->num_failed;
+                if (first_error == 0) {
+                    first_error = result.error;
+                }
+            } else {
+                ++report->num_verified;
+                report->bytes_verified += entry_index.GetUncompressedLength(result.index);
+            }
+        }
+        HLOGI("+++ verified %u entries (%" PRIu64 " bytes), %u failed, %u skipped, on %zu threads",
+              report->num_verified, report->bytes_verified, report->num_failed,
+              report->num_skipped, pool.GetNumThreads());
+        return first_error;
     }
 
     const char *ZipFile::ErrorCodeString(int32_t error_code) {
@@ -38,21 +38,6 @@
 
 #define LOG_TAG "unzip"
 
-static bool MakeDirHierarchy(const std::string &path) {
-    struct stat sb{};
-    if (stat(path.c_str(), &sb) != -1 && S_ISDIR(sb.st_mode)) {
-        return true;
-    }
-
-    // 递归创建目录，现保证父目录创建成功
-    if (!MakeDirHierarchy(hms::File::Dirname(path))) {
-        return false;
-    }
-
-    // 最后创建此目录
-    return (mkdir(path.c_str(), 0777) != -1);
-}
-
 static std::string GetFileNameBase(const std::string &name) {
     int lastSlash = name.find_last_of(OS_PATH_SEPARATOR);
     return name.substr(lastSlash + 1);;
@@ -72,7 +57,7 @@ ExtractOne(hms::ZipFile &zipFile, ZipEntry &entry, const std::string &name, cons
     dstPath += GetFileNameBase(name);
 
     // 创建目录
-    if (!MakeDirHierarchy(hms::File::Dirname(targetDir))) {
+    if (!hms::File::MakeDirs(hms::File::Dirname(targetDir))) {
         HLOGE("couldn't create directory hierarchy for %s", dstPath.c_str());
     }
 
@@ -90,10 +75,10 @@ ExtractOne(hms::ZipFile &zipFile, ZipEntry &entry, const std::string &name, cons
 //    }
 
     // 创建解压文件
-    int fd = open(dstPath.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC | O_EXCL, entry.unix_mode);
+    int fd = open(dstPath.c_str(), O_CREAT | O_RDWR | O_CLOEXEC | O_EXCL, entry.unix_mode);
     if (fd == -1 && errno == EEXIST) {
         HLOGI("%s exsits, will overwrite it!", dstPath.c_str());
-        fd = open(dstPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | O_TRUNC, entry.unix_mode);
+        fd = open(dstPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_TRUNC, entry.unix_mode);
     }
     if (fd == -1) {
         HLOGE("couldn't create file %s", dstPath.c_str());
@@ -113,29 +98,15 @@ ExtractOne(hms::ZipFile &zipFile, ZipEntry &entry, const std::string &name, cons
 static void
 Process(hms::ZipFile &zipFile, const std::string &extractfileName, const char *targetDir) {
     HLOGENTRY();
-    int err = zipFile.StartIteration(nullptr, nullptr);
+    ZipEntry entry{};
+    ZipString zipString(extractfileName.c_str());
+    int err = zipFile.FindEntry(zipString, &entry);
     if (err != 0) {
-        HLOGE("couldn't iterate %s", zipFile.ErrorCodeString(err));
+        HLOGE("couldn't find %s: %s", extractfileName.c_str(), zipFile.ErrorCodeString(err));
         return;
     }
 
-    ZipEntry entry{};
-    ZipString zipString;
-    {
-        HLOGTENTRY("find entry");
-        while ((err = zipFile.Next(&entry, &zipString)) >= 0) {
-            std::string name(zipString.name, zipString.name + zipString.name_length);
-            if (extractfileName == name) {
-                ExtractOne(zipFile, entry, extractfileName, targetDir);
-                break;
-            }
-        }
-
-    }
-
-    if (err < -1) {
-        HLOGE("failed iterating: %s", zipFile.ErrorCodeString(err));
-    }
+    ExtractOne(zipFile, entry, extractfileName, targetDir);
 }
 
 
@@ -18,10 +18,20 @@
 #define ANDROID_BASE_UTF8_H
 
 #include <fcntl.h>      // open
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>      // fopen
 #include <sys/stat.h>   // mkdir
 #include <unistd.h>     // unlink
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace android {
 namespace base {
 
@@ -50,6 +60,67 @@ using ::unlink;
 
 
 }  // namespace utf8
+
+// Returns a pointer to the first byte in [begin, end) that is either NUL or
+// not 7-bit ASCII, or |end| if there is none. Whole vectors are tested at a
+// time (32 bytes with AVX2, 16 bytes with SSE2 or NEON), so runs of plain
+// ASCII cost about one compare per vector.
+inline const uint8_t* SkipAscii(const uint8_t* begin, const uint8_t* end) {
+  const uint8_t* p = begin;
+#if defined(__AVX2__)
+  const __m256i zero = _mm256_setzero_si256();
+  for (; end - p >= 32; p += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    // The high bit of a lane is set if the byte is non-ASCII or was NUL.
+    if (_mm256_movemask_epi8(_mm256_or_si256(v, _mm256_cmpeq_epi8(v, zero))) != 0) break;
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero))) != 0) break;
+  }
+#elif defined(__aarch64__)
+  const uint8x16_t zero = vdupq_n_u8(0);
+  for (; end - p >= 16; p += 16) {
+    const uint8x16_t v = vld1q_u8(p);
+    if (vmaxvq_u8(vorrq_u8(v, vceqq_u8(v, zero))) >= 0x80) break;
+  }
+#endif
+  while (p < end && *p != 0 && (*p & 0x80) == 0) {
+    ++p;
+  }
+  return p;
+}
+
+// Tests whether the |length| bytes at |data| form valid UTF-8 without any
+// NUL (U+0000) characters, as required of zip entry names and C strings.
+//
+// Multi-byte sequences are checked for their lead and continuation bytes
+// only; overlong encodings and surrogates are accepted. ASCII runs are
+// skipped with SkipAscii, so mostly-ASCII input validates at vector speed.
+inline bool IsValidUtf8(const uint8_t* data, size_t length) {
+  const uint8_t* p = data;
+  const uint8_t* const end = data + length;
+  while ((p = SkipAscii(p, end)) != end) {
+    const uint8_t byte = *p++;
+    if (byte == 0 || (byte & 0xc0) == 0x80 || (byte & 0xfe) == 0xfe) {
+      // NUL, stray continuation byte or invalid lead byte.
+      return false;
+    }
+
+    // 2-5 byte sequences.
+    for (uint8_t first = byte << 1; first & 0x80; first <<= 1) {
+      if (p == end || (*p & 0xc0) != 0x80) {
+        // Missing or invalid continuation byte.
+        return false;
+      }
+      ++p;
+    }
+  }
+  return true;
+}
+
 }  // namespace base
 }  // namespace android
 